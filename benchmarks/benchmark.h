@@ -0,0 +1,75 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <common/basic_types.h>
+#include <engine/ecs.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Minimal benchmark registry. Each benchmark is a free function registered at static init time,
+// and the suite runs either all of them or the ones named on the command line.
+using benchmark_func = void (*)();
+struct benchmark_entry {
+	std::string name;
+	benchmark_func func;
+};
+
+std::vector<benchmark_entry>& benchmark_registry();
+int register_benchmark(std::string name, benchmark_func);
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static int name##_registration = register_benchmark(#name, name); \
+	static void name()
+
+// Runs func the given number of times, and returns the average time per run in milliseconds.
+template <typename F>
+f32 time_ms(int iterations, F&& func) {
+	timer t;
+	for (int i = 0; i < iterations; i++) func();
+	return t.elapsed<timer::microseconds>().count() / 1000.0f / iterations;
+}
+
+// Component pools for entities set up the way the egen_ functions would, without a window or texture manager behind them.
+// Sprites all use one blank texture, and systems run on a pool with no workers. Benchmarks needing more state derive from it.
+struct bench_scene {
+	ecs::pool<ecs::display> displays;
+	ecs::pool<ecs::transform> transforms;
+	ecs::pool<ecs::velocity> velocities;
+	ecs::pool<ecs::collision> collisions;
+	texture tex {0, image(), size<u16>(1, 1)};
+	thread_pool serial {0};
+
+	// A display of one quad laid out at pos, in the entity's local space if it has a transform
+	ecs::display& add_sprite(entity e, sprite_coords pos, sprite_coords quad_size, u16 z_index) {
+		auto& dpy = displays.add(e, ecs::display());
+		dpy.parent = e;
+		dpy.add_sprite(1, &tex, z_index, render_layers::sprites);
+		dpy.sprites(0).set_pos(pos, quad_size, 0);
+		return dpy;
+	}
+	ecs::pool<ecs::transform>::reference add_transform(entity e, world_coords position) {
+		auto t = transforms.add(e, ecs::transform());
+		t.set_position(position);
+		return t;
+	}
+	ecs::velocity& add_velocity(entity e, world_coords delta) {
+		auto& v = velocities.add(e, ecs::velocity());
+		v.parent = e;
+		v.delta = delta;
+		return v;
+	}
+};
+
+// Builds a scene on the heap, since its pools are too big for the stack, then calls populate(scene, e) for each of
+// count entities
+template <typename scene = bench_scene, typename F>
+std::unique_ptr<scene> build_scene(size_t count, F&& populate) {
+	auto s = std::make_unique<scene>();
+	for (entity e = 0; e < count; e++) populate(*s, e);
+	return s;
+}
+
+#endif //BENCHMARK_H
@@ -0,0 +1,70 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <random>
+#include <cmath>
+
+// Entities here mirror egen_bullet and egen_enemy, without needing a window or a texture manager behind them.
+namespace {
+
+struct collision_scene : bench_scene {
+    ecs::mapdata map;
+    ecs::s_collision system;
+    size_t hits = 0;
+};
+
+void spawn_bullet(collision_scene& s, entity e, world_coords source, world_coords dest) {
+    s.add_sprite(e, world_coords(-0.15, -0.3), world_coords(0.3, 0.6), 3);
+    auto t = s.add_transform(e, source + world_coords(0.15, 0.3));
+    t.set_rotation(atan2(dest.x - source.x, (source.y - dest.y)));
+
+    auto& c = s.collisions.add(e, ecs::collision());
+    c.parent = e;
+    c.set_team_signal(ecs::collision::flags::ally);
+
+    world_coords delta = dest - source;
+    f32 length = sqrt(delta.x * delta.x + delta.y * delta.y);
+    s.add_velocity(e, delta * (0.25f / length));
+}
+
+void spawn_enemy(collision_scene& s, entity e, world_coords pos) {
+    s.add_sprite(e, pos, sprite_coords(1, 1), 2);
+
+    auto& c = s.collisions.add(e, ecs::collision());
+    c.parent = e;
+    c.disabled_sprites.set(1);
+    c.set_team_signal(ecs::collision::flags::enemy);
+    c.set_team_detector(ecs::collision::flags::ally);
+}
+
+// Half bullets, half enemies, scattered over a 32x32 dungeon
+std::unique_ptr<collision_scene> build_collision_scene(size_t num_entities) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<f32> coord(0, 32);
+    return build_scene<collision_scene>(num_entities, [&](collision_scene& s, entity e) {
+        if (e % 2 == 0) spawn_bullet(s, e, world_coords(coord(rng), coord(rng)), world_coords(coord(rng), coord(rng)));
+        else spawn_enemy(s, e, world_coords(coord(rng), coord(rng)));
+    });
+}
+
+}
+
+BENCHMARK(collision_broadphase) {
+    constexpr int ticks = 60;
+    // Hundreds of bullets and enemies is what a dungeon fight reaches, with a few larger crowds for scaling
+    for (size_t count : {100, 200, 300, 500, 800, 1024, 4096}) {
+        for (bool broadphase : {false, true}) {
+            auto scene = build_collision_scene(count);
+            scene->system.use_broadphase = broadphase;
+            size_t pairs = 0;
+            f32 ms = time_ms(ticks, [&]() {
+                ecs::system_velocity_run(scene->serial, scene->velocities, scene->transforms, 2);
+                scene->system.run(scene->serial, ecs::view<ecs::collision, ecs::display>(scene->collisions, scene->displays), scene->collisions, scene->transforms, scene->map);
+                pairs += scene->system.pairs_tested;
+                scene->hits += scene->system.contacts.size();
+            });
+            // Report the population actually simulated, so a capped entity store can't pass off a smaller scene
+            printf("%5zu entities, %-11s: %8zu pairs/tick, %8.3f ms/tick, %zu hits\n",
+                   scene->collisions.size(), broadphase ? "broad phase" : "all pairs", pairs / ticks, ms, scene->hits);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <engine/render_list.h>
+#include <cstring>
+#include <random>
+
+namespace {
+
+constexpr size_t num_entities = 10000;
+
+// Moving bullet-like entities spread over a 256x256 tile world, with a 1080p camera's worth of it on screen
+struct culling_scene : bench_scene {
+    display::render_list list;
+    std::vector<quad_instance> upload = std::vector<quad_instance>(num_entities);
+};
+
+std::unique_ptr<culling_scene> build_culling_scene() {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<f32> coord(0, 256);
+    return build_scene<culling_scene>(num_entities, [&](culling_scene& s, entity e) {
+        s.add_sprite(e, sprite_coords(-0.15, -0.3), sprite_coords(0.3, 0.6), 3);
+        s.add_transform(e, world_coords(coord(rng), coord(rng)));
+        s.add_velocity(e, world_coords(0.1, 0.05));
+    });
+}
+
+// Submission as in engine::run_tick, then the copy into the upload buffer that batching does for every submitted quad
+size_t run_frame(culling_scene& s, bool cull, rect<f32> camera) {
+    s.list.begin_submission();
+    for (auto& dpy : s.displays) {
+        if (cull && !AABB_collision(ecs::world_bounds(dpy, s.transforms), camera)) continue;
+        ecs::transform t = s.transforms.get(dpy.parent).value();
+        display::sprite_placement placement {t.position, t.rotation, t.scale};
+        for (auto& sprite : dpy) s.list.submit(sprite, &placement);
+    }
+    s.list.end_submission();
+
+    size_t quads = 0;
+    for (u32 handle : s.list.draw_order()) {
+        const std::vector<quad_instance>& instances = s.list.instances(handle);
+        memcpy(s.upload.data() + quads, instances.data(), instances.size() * sizeof(quad_instance));
+        quads += instances.size();
+    }
+    return quads;
+}
+
+}
+
+// Before: every entity in the world is submitted and batched. After: entities off camera are skipped before submission.
+BENCHMARK(culling) {
+    rect<f32> camera(point<f32>(100, 100), size<f32>(1920 / 64.0f, 1080 / 64.0f));
+    for (bool cull : {false, true}) {
+        auto s = build_culling_scene();
+        size_t quads = 0;
+        f32 ms = time_ms(100, [&]() {
+            ecs::system_velocity_run(s->serial, s->velocities, s->transforms, 2);
+            quads = run_frame(*s, cull, camera);
+        });
+        printf("%zu moving entities, %-8s: %8.3f ms/tick, %5zu quads batched\n", num_entities, cull ? "culled" : "all", ms, quads);
+    }
+}
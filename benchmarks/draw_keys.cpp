@@ -0,0 +1,62 @@
+#include "benchmark.h"
+#include <common/graphical_types.h>
+#include <common/radix_sort.h>
+#include <algorithm>
+#include <random>
+
+// 100k sprites over every layer, 16 z indices and 64 textures, in random submission order.
+// Before: std::sort over sprites with the old comparator, which wasn't a strict weak ordering and chased texture pointers.
+// After: std::sort and radix_sort over packed sprite_data::sort_key values.
+BENCHMARK(draw_keys) {
+    constexpr size_t count = 100000;
+    constexpr int runs = 20;
+    std::vector<texture> textures;
+    for (u32 i = 0; i < 64; i++) textures.push_back(texture {i, image(), size<u16>(1, 1)});
+
+    std::mt19937 rng(1234);
+    std::vector<sprite_data> sprites;
+    sprites.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        sprites.emplace_back(1, &textures[rng() % 64], rng() % 16, render_layers(1 + rng() % 3));
+    }
+
+    auto old_less = [](const sprite_data* a, const sprite_data* b) {
+        if (a->layer < b->layer) return true;
+        if (a->z_index < b->z_index) return true;
+        if (a->tex->id < b->tex->id) return true;
+        return false;
+    };
+    std::vector<const sprite_data*> pointers;
+    // Far slower than the rest, so it only runs once
+    f32 comparator_ms = time_ms(1, [&]() {
+        pointers.clear();
+        for (auto& s : sprites) pointers.push_back(&s);
+        std::sort(pointers.begin(), pointers.end(), old_less);
+    });
+
+    struct draw_entry {
+        u64 key;
+        u32 index;
+    };
+    std::vector<draw_entry> entries, scratch;
+    auto fill_entries = [&]() {
+        entries.clear();
+        for (u32 i = 0; i < count; i++) entries.push_back(draw_entry {sprites[i].sort_key(), i});
+    };
+    f32 std_sort_ms = time_ms(runs, [&]() {
+        fill_entries();
+        std::sort(entries.begin(), entries.end(), [](const draw_entry& a, const draw_entry& b) { return a.key < b.key; });
+    });
+    f32 radix_ms = time_ms(runs, [&]() {
+        fill_entries();
+        radix_sort(entries, scratch, [](const draw_entry& e) { return e.key; });
+    });
+
+    size_t misordered = 0;
+    for (size_t i = 1; i < pointers.size(); i++) misordered += pointers[i]->sort_key() < pointers[i - 1]->sort_key();
+    bool radix_sorted = std::is_sorted(entries.begin(), entries.end(), [](const draw_entry& a, const draw_entry& b) { return a.key < b.key; });
+
+    printf("%zu sprites, old comparator:     %8.3f ms, %zu neighbours out of draw order\n", count, comparator_ms, misordered);
+    printf("%zu sprites, std::sort on keys:  %8.3f ms\n", count, std_sort_ms);
+    printf("%zu sprites, radix sort on keys: %8.3f ms, %s\n", count, radix_ms, radix_sorted ? "sorted" : "NOT SORTED");
+}
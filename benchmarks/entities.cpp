@@ -0,0 +1,54 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <deque>
+#include <memory>
+
+// Keeps a steady population of bullet-like entities while creating and destroying 10k of them per second.
+BENCHMARK(entity_churn) {
+    constexpr int ticks_per_second = 60;
+    constexpr int churn_per_second = 10000;
+    constexpr int churn_per_tick = churn_per_second / ticks_per_second;
+    texture tex {0, image(), size<u16>(1, 1)};
+    thread_pool serial(0);
+
+    for (size_t population : {1000, 10000, 30000}) {
+        auto entities = std::make_unique<ecs::entity_manager>();
+        auto components = std::make_unique<ecs::component_manager>();
+        std::deque<entity> live;
+        std::vector<entity> destroyed_handles;
+        size_t stale_detected = 0;
+
+        auto spawn = [&]() {
+            entity e = entities->add_entity();
+            auto& spr = components->get_pool(ecs::type_tag<ecs::display>()).add(e, ecs::display());
+            spr.add_sprite(1, &tex, 3, render_layers::sprites);
+            spr.sprites(0).set_pos(sprite_coords(-0.15, -0.3), sprite_coords(0.3, 0.6), 0);
+            components->get_pool(ecs::type_tag<ecs::transform>()).add(e, ecs::transform()).set_position(world_coords(e % 64, e % 32));
+            components->get_pool(ecs::type_tag<ecs::velocity>()).add(e, ecs::velocity());
+            components->get_pool(ecs::type_tag<ecs::collision>()).add(e, ecs::collision());
+            components->get_pool(ecs::type_tag<ecs::damage>()).add(e, ecs::damage());
+            live.push_back(e);
+        };
+        for (size_t i = 0; i < population; i++) spawn();
+
+        f32 ms = time_ms(ticks_per_second * 2, [&]() {
+            for (int i = 0; i < churn_per_tick; i++) {
+                entities->mark_entity(live.front());
+                live.pop_front();
+                spawn();
+            }
+            ecs::system_velocity_run(serial, components->get_pool(ecs::type_tag<ecs::velocity>()), components->get_pool(ecs::type_tag<ecs::transform>()), 2);
+            for (auto e : entities->remove_marked()) {
+                components->remove_all(e);
+                destroyed_handles.push_back(e);
+            }
+        });
+
+        // Every destroyed handle should be recognised as stale, even though its index has been recycled
+        for (auto e : destroyed_handles) {
+            if (!entities->alive(e) && !components->get_pool(ecs::type_tag<ecs::display>()).exists(e)) stale_detected++;
+        }
+        printf("%6zu live entities, %d created + destroyed per tick: %8.3f ms/tick, %zu/%zu stale handles detected\n",
+               entities->num_alive(), churn_per_tick, ms, stale_detected, destroyed_handles.size());
+    }
+}
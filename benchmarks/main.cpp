@@ -0,0 +1,27 @@
+#include "benchmark.h"
+
+std::vector<benchmark_entry>& benchmark_registry() {
+    static std::vector<benchmark_entry> registry;
+    return registry;
+}
+
+int register_benchmark(std::string name, benchmark_func func) {
+    benchmark_registry().push_back(benchmark_entry{name, func});
+    return 0;
+}
+
+// Usage: bench_suite [benchmark names...]. With no arguments, every benchmark runs.
+int main(int argc, char** argv) {
+    for (auto& entry : benchmark_registry()) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            if (entry.name == argv[i]) selected = true;
+        }
+        if (!selected) continue;
+
+        printf("[%s]\n", entry.name.c_str());
+        entry.func();
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+
+namespace {
+
+constexpr size_t num_movers = 10000;
+
+// The same bullet-like entity laid out both ways: world space vertices, and local vertices placed by a transform
+struct movement_scene : bench_scene {
+    ecs::pool<ecs::display> world_displays;
+};
+
+std::unique_ptr<movement_scene> build_movement_scene() {
+    return build_scene<movement_scene>(num_movers, [](movement_scene& s, entity e) {
+        world_coords pos(e % 64, e % 32);
+        auto& world = s.world_displays.add(e, ecs::display());
+        world.add_sprite(1, &s.tex, 3, render_layers::sprites);
+        world.sprites(0).set_pos(pos, sprite_coords(0.3, 0.6), 0);
+
+        s.add_sprite(e, sprite_coords(-0.15, -0.3), sprite_coords(0.3, 0.6), 3);
+        s.add_transform(e, pos);
+        s.add_velocity(e, sprite_coords(0.1, 0.2));
+    });
+}
+
+}
+
+// A 10k entity movement tick. Before: system_velocity_run moving every vertex of every sprite.
+// After: moving transforms, with and without generating world vertices for rendering the way engine::run_tick does.
+BENCHMARK(movement) {
+    auto s = build_movement_scene();
+    f32 vertices_ms = time_ms(200, [&]() {
+        for (auto [velocity, spr] : ecs::view<ecs::velocity, ecs::display>(s->velocities, s->world_displays)) {
+            sprite_coords delta(velocity.delta.x / 2, velocity.delta.y / 2);
+            for (auto& sprite : spr) sprite.move_by(delta);
+        }
+    });
+    f32 transforms_ms = time_ms(200, [&]() { ecs::system_velocity_run(s->serial, s->velocities, s->transforms, 2); });
+
+    std::vector<sprite_data> submitted;
+    submitted.reserve(num_movers);
+    f32 submit_ms = time_ms(200, [&]() {
+        submitted.clear();
+        for (auto& dpy : s->displays) {
+            ecs::transform t = s->transforms.get(dpy.parent).value();
+            for (auto& sprite : dpy) {
+                submitted.push_back(sprite);
+                submitted.back().apply_transform(t.position, t.rotation, t.scale);
+            }
+        }
+    });
+    printf("%zu entities, sprite vertices:          %8.3f ms/tick\n", num_movers, vertices_ms);
+    printf("%zu entities, transforms:               %8.3f ms/tick\n", num_movers, transforms_ms);
+    printf("%zu entities, world vertices at submit: %8.3f ms/tick\n", num_movers, submit_ms);
+}
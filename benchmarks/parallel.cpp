@@ -0,0 +1,35 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <thread>
+
+namespace {
+
+std::unique_ptr<bench_scene> build_movers(size_t count) {
+    return build_scene(count, [](bench_scene& s, entity e) {
+        s.add_transform(e, world_coords(e % 64, e % 32));
+        s.add_velocity(e, sprite_coords(0.1, 0.2));
+    });
+}
+
+}
+
+// system_velocity_run over a full population, split across 1 to N threads, and in deterministic mode
+BENCHMARK(parallel_for_scaling) {
+    size_t max_threads = std::max(4u, std::thread::hardware_concurrency());
+    printf("    %u hardware threads\n", std::thread::hardware_concurrency());
+    for (size_t count : {1024, 8192, 65535}) {
+        auto m = build_movers(count);
+        auto run = [&](thread_pool& workers) {
+            return time_ms(200, [&]() {
+                ecs::system_velocity_run(workers, m->velocities, m->transforms, 2);
+            });
+        };
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            thread_pool workers(threads - 1);
+            printf("%6zu entities, %2zu threads:       %8.3f ms/tick\n", count, threads, run(workers));
+        }
+        thread_pool workers(max_threads - 1);
+        workers.deterministic = true;
+        printf("%6zu entities, deterministic:    %8.3f ms/tick\n", count, run(workers));
+    }
+}
@@ -0,0 +1,75 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+namespace {
+
+constexpr size_t id_range = 4096;
+
+// Sums every element, the same access pattern as system_velocity_run
+template <typename storage>
+f32 iterate(storage& s) {
+    f32 total = 0;
+    for (auto& v : s) total += v.delta.x + v.delta.y;
+    return total;
+}
+
+template <typename storage>
+void run_pool_benchmark(const char* name, std::vector<size_t>& ids) {
+    auto s = std::make_unique<storage>();
+    for (auto id : ids) s->add(id, ecs::velocity{{}, sprite_coords(1, 1)});
+
+    volatile f32 sink = 0;
+    f32 iterate_ms = time_ms(1000, [&]() { sink = sink + iterate(*s); });
+    f32 churn_ms = time_ms(1000, [&]() {
+        for (auto id : ids) s->remove(id);
+        for (auto id : ids) s->add(id, ecs::velocity{{}, sprite_coords(1, 1)});
+    });
+    printf("    %-15s iterate %8.2f us, remove + add all %8.2f us\n", name, iterate_ms * 1000, churn_ms * 1000);
+}
+
+}
+
+BENCHMARK(component_pools) {
+    std::mt19937 rng(1234);
+    for (size_t live : {id_range / 100, id_range / 10, id_range}) {
+        std::vector<size_t> ids(id_range);
+        for (size_t i = 0; i < id_range; i++) ids[i] = i;
+        std::shuffle(ids.begin(), ids.end(), rng);
+        ids.resize(live);
+
+        printf("%zu live of %zu ids:\n", live, id_range);
+        run_pool_benchmark<marked_storage<ecs::velocity, id_range>>("marked_storage", ids);
+        run_pool_benchmark<paged_storage<ecs::velocity>>("paged_storage", ids);
+        run_pool_benchmark<sparse_storage<ecs::velocity>>("sparse_storage", ids);
+    }
+}
+
+// Velocity joined with display, the way system_velocity_run reads them: a view against per-entity lookups.
+BENCHMARK(component_views) {
+    for (size_t num_entities : {1000, 10000, 60000}) {
+        auto velocities = std::make_unique<ecs::pool<ecs::velocity>>();
+        auto displays = std::make_unique<ecs::pool<ecs::display>>();
+        // Every entity is displayed, every fourth one moves
+        for (entity e = 0; e < num_entities; e++) {
+            displays->add(e, ecs::display());
+            if (e % 4 == 0) velocities->add(e, ecs::velocity{{}, sprite_coords(1, 1)});
+        }
+
+        volatile size_t sink = 0;
+        f32 lookup_ms = time_ms(200, [&]() {
+            for (auto& v : *velocities) {
+                if (!displays->exists(v.parent)) continue;
+                sink = sink + displays->get(v.parent).parent;
+            }
+        });
+        f32 view_ms = time_ms(200, [&]() {
+            for (auto [v, d] : ecs::view<ecs::velocity, ecs::display>(*velocities, *displays)) {
+                sink = sink + d.parent;
+            }
+        });
+        printf("%6zu entities: per-entity lookups %8.2f us, view %8.2f us\n", num_entities, lookup_ms * 1000, view_ms * 1000);
+    }
+}
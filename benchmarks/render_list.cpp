@@ -0,0 +1,66 @@
+#include "benchmark.h"
+#include <engine/render_list.h>
+#include <algorithm>
+
+namespace {
+
+constexpr size_t num_sprites = 10000;
+
+// A map's worth of static sprites with a share of them moving by transform, across a handful of textures
+struct render_scene {
+    std::vector<texture> textures;
+    std::vector<sprite_data> sprites;
+    std::vector<display::sprite_placement> placements;
+
+    render_scene() {
+        for (u32 i = 0; i < 8; i++) textures.push_back(texture {i, image(), size<u16>(1, 1)});
+        sprites.reserve(num_sprites);
+    }
+};
+
+std::unique_ptr<render_scene> build_render_scene() {
+    return build_scene<render_scene>(num_sprites, [](render_scene& s, entity i) {
+        s.sprites.emplace_back(1, &s.textures[i % 8], i % 5, render_layers::sprites);
+        s.sprites.back().set_pos(sprite_coords(-0.5, -0.5), sprite_coords(1, 1), 0);
+        s.placements.push_back(display::sprite_placement {sprite_coords(i % 100, i / 100), 0, sprite_coords(1, 1)});
+    });
+}
+
+// Moves every nth sprite a little
+void move_sprites(render_scene& s, size_t every) {
+    for (size_t i = 0; i < num_sprites; i += every) s.placements[i].position.x += 0.01f;
+}
+
+}
+
+// Before: every tick copies every sprite into a fresh batching pool, places it, and sorts the whole pool.
+// After: sprites are submitted into a persistent render list, which only copies what changed and sorts when needed.
+BENCHMARK(render_list) {
+    for (size_t every : {0, 100, 10, 1}) {
+        auto s = build_render_scene();
+        std::vector<sprite_data> batching_pool;
+        f32 rebuild_ms = time_ms(100, [&]() {
+            if (every != 0) move_sprites(*s, every);
+            batching_pool.clear();
+            for (size_t i = 0; i < num_sprites; i++) {
+                batching_pool.emplace_back(s->sprites[i]);
+                display::sprite_placement& p = s->placements[i];
+                batching_pool.back().apply_transform(p.position, p.rotation, p.scale);
+            }
+            std::sort(batching_pool.begin(), batching_pool.end());
+        });
+
+        display::render_list list;
+        size_t updated = 0;
+        f32 persistent_ms = time_ms(100, [&]() {
+            if (every != 0) move_sprites(*s, every);
+            list.begin_submission();
+            for (size_t i = 0; i < num_sprites; i++) list.submit(s->sprites[i], &s->placements[i]);
+            list.end_submission();
+            list.draw_order();
+            updated += list.sprites_updated;
+        });
+        printf("%zu sprites, %5zu moving: rebuild %8.3f ms/tick, render list %8.3f ms/tick, %zu updated/tick, %zu sorts\n",
+               num_sprites, every == 0 ? 0 : num_sprites / every, rebuild_ms, persistent_ms, updated / 100, list.times_sorted);
+    }
+}
@@ -0,0 +1,252 @@
+#include "benchmark.h"
+#include <engine/scaled_texture_cache.h>
+#include <engine/tiled_rasterizer.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <thread>
+
+namespace {
+
+constexpr u16 screen_width = 1920;
+constexpr u16 screen_height = 1080;
+
+// Random colors. Cutouts are runs of transparent or opaque texels, with some partially transparent runs for their edges.
+display::raster_texture random_texture(size<u16> tex_size, std::mt19937& rng, bool cutout) {
+    std::vector<u8> pixels(size_t(tex_size.x) * tex_size.y * 4);
+    u32 coverage = 0;
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        if (i % 64 == 0) coverage = rng() % 10;
+        pixels[i] = rng();
+        pixels[i + 1] = rng();
+        pixels[i + 2] = rng();
+        pixels[i + 3] = !cutout || coverage < 3 ? 255 : coverage < 8 ? 0 : rng();
+    }
+    return display::raster_texture(image(pixels, tex_size));
+}
+
+// The hub as renderer_software sees it at 1080p: a screen of 64x64 map tiles from the 4x scaled tilemap, NPCs, the player
+// and bullets over it, then the menu panel with its buttons and a few hundred glyphs of text on top
+struct hub_scene {
+    std::mt19937 rng {1234};
+    display::raster_texture tilemap = random_texture(size<u16>(320, 192), rng, false);
+    display::raster_texture player = random_texture(size<u16>(64, 64), rng, true);
+    display::raster_texture bullet = random_texture(size<u16>(20, 40), rng, true);
+    display::raster_texture panel = random_texture(size<u16>(640, 480), rng, false);
+    display::raster_texture button = random_texture(size<u16>(300, 64), rng, false);
+    display::raster_texture glyphs = random_texture(size<u16>(160, 160), rng, true);
+
+    struct quad {
+        display::raster_texture* tex;
+        point<i32> texel;
+        point<f32> tl;
+        point<f32> br;
+    };
+    std::vector<quad> quads;
+
+    void add(display::raster_texture& tex, point<f32> pos, size<f32> quad_size, point<i32> texel) {
+        quads.push_back(quad {&tex, texel, pos, pos + quad_size});
+    }
+
+    hub_scene() {
+        // A camera between tiles, so the map overhangs every screen edge
+        point<f32> camera(-37, -21);
+        for (f32 y = camera.y; y < screen_height; y += 64) {
+            for (f32 x = camera.x; x < screen_width; x += 64) {
+                add(tilemap, point<f32>(x, y), size<f32>(64, 64), point<i32>((rng() % 5) * 64, (rng() % 3) * 64));
+            }
+        }
+        std::uniform_real_distribution<f32> x_pos(-32, screen_width), y_pos(-32, screen_height);
+        for (int i = 0; i < 40; i++) add(player, point<f32>(x_pos(rng), y_pos(rng)), size<f32>(64, 64), point<i32>(0, 0));
+        for (int i = 0; i < 200; i++) add(bullet, point<f32>(x_pos(rng), y_pos(rng)), size<f32>(20, 40), point<i32>(0, 0));
+        add(player, point<f32>(928, 508), size<f32>(64, 64), point<i32>(0, 0));
+
+        add(panel, point<f32>(640, 300), size<f32>(640, 480), point<i32>(0, 0));
+        for (int i = 0; i < 5; i++) add(button, point<f32>(810, 340 + i * 80), size<f32>(300, 64), point<i32>(0, 0));
+        for (int i = 0; i < 600; i++) {
+            point<i32> glyph((rng() % 16) * 10, (rng() % 8) * 20);
+            add(glyphs, point<f32>(100 + (i % 60) * 10, 100 + (i / 60) * 20), size<f32>(10, 20), glyph);
+        }
+    }
+};
+
+}
+
+// One frame of the hub through the tiled software rasterizer, for every thread count up to the machine's cores.
+// The checksum shows every thread count produces the same image.
+BENCHMARK(software_raster) {
+    constexpr int frames = 30;
+    hub_scene scene;
+    std::vector<u8> pixels(size_t(screen_width) * screen_height * 4);
+    framebuffer fb(pixels.data(), size<u16>(screen_width, screen_height));
+    display::tiled_rasterizer raster(0);
+
+    size_t max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads++) {
+        raster.set_workers(threads - 1);
+        f32 ms = time_ms(frames, [&]() {
+            raster.begin_frame(fb, true);
+            for (auto& q : scene.quads) raster.add(*q.tex, q.texel, q.tl, q.br);
+            raster.finish_frame();
+        });
+        u64 checksum = 0;
+        for (size_t i = 0; i < pixels.size(); i += 4) checksum = checksum * 31 + (pixels[i] | pixels[i + 1] << 8 | pixels[i + 2] << 16);
+        printf("%2zu threads: %7.3f ms/frame at %ux%u, %zu quads (%zu opaque), checksum %016llx\n",
+               threads, ms, screen_width, screen_height, raster.quads_added(), raster.opaque_quads(), (unsigned long long)checksum);
+    }
+}
+
+// Pixels per second written by the opaque copy, the portable blend and blend_span, over 1080p worth of rows of
+// cutout texels, the kind text and sprites are made of
+BENCHMARK(blend_throughput) {
+    constexpr int frames = 20;
+    std::mt19937 rng(1234);
+    display::raster_texture src = random_texture(size<u16>(screen_width, 64), rng, true);
+    std::vector<u8> dest(size_t(screen_width) * 4, 128);
+    const u8* src_pixels = src.pixels().data().data();
+    size_t pixels_per_frame = size_t(screen_width) * screen_height;
+
+    auto run = [&](const char* name, auto&& write_row) {
+        f32 ms = time_ms(frames, [&]() {
+            for (size_t row = 0; row < screen_height; row++) write_row(dest.data(), src_pixels + (row % 64) * screen_width * 4, screen_width);
+        });
+        printf("%-12s: %8.3f ms/frame, %7.1f Mpixels/s\n", name, ms, pixels_per_frame / (ms * 1000.0f));
+    };
+    run("memcpy", [](u8* d, const u8* s, size_t n) { memcpy(d, s, n * 4); });
+    run("scalar blend", [](u8* d, const u8* s, size_t n) { display::blend_span_scalar(d, s, n); });
+    run("blend_span", [](u8* d, const u8* s, size_t n) { display::blend_span(d, s, n); });
+}
+
+namespace {
+
+// The hub with the UI scaled to 1.5x: 16 texel map tiles drawn at 64x64, glyphs and buttons at 1.5x, and one sprite
+// zooming so that its size changes every frame
+struct scaled_quad {
+    display::raster_texture* tex;
+    u32 texture_id;
+    rect<i32> region;
+    point<f32> tl;
+    size<f32> quad_size;
+};
+
+std::vector<scaled_quad> scaled_hub(display::raster_texture* textures) {
+    std::mt19937 rng(1234);
+    std::vector<scaled_quad> quads;
+    for (f32 y = -21; y < screen_height; y += 64) {
+        for (f32 x = -37; x < screen_width; x += 64) {
+            rect<i32> tile(point<i32>((rng() % 5) * 16, (rng() % 3) * 16), size<i32>(16, 16));
+            quads.push_back(scaled_quad {&textures[0], 0, tile, point<f32>(x, y), size<f32>(64, 64)});
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        quads.push_back(scaled_quad {&textures[1], 1, rect<i32>(point<i32>(0, 0), size<i32>(300, 64)), point<f32>(735, 300 + i * 120), size<f32>(450, 96)});
+    }
+    for (int i = 0; i < 600; i++) {
+        rect<i32> glyph(point<i32>((rng() % 16) * 10, (rng() % 8) * 20), size<i32>(10, 20));
+        quads.push_back(scaled_quad {&textures[2], 2, glyph, point<f32>(100 + (i % 60) * 15, 100 + (i / 60) * 30), size<f32>(15, 30)});
+    }
+    return quads;
+}
+
+// What render_batch used to do for quads that weren't 1x, 2x or 4x their texture: scale the whole texture to the quad
+image rescale_whole_texture(display::raster_texture& source, size<u16> new_size) {
+    image scaled(std::vector<u8>(size_t(new_size.x) * new_size.y * 4), new_size);
+    for (u16 y = 0; y < new_size.y; y++) {
+        for (u16 x = 0; x < new_size.x; x++) {
+            size_t read = (size_t(y) * source.size().y / new_size.y) * source.size().x + size_t(x) * source.size().x / new_size.x;
+            memcpy(scaled.data().data() + (size_t(y) * new_size.x + x) * 4, source.pixels().data().data() + read * 4, 4);
+        }
+    }
+    return scaled;
+}
+
+}
+
+// A frame of the 1.5x hub three ways: rescaling a whole texture per quad as render_batch used to, sampling every quad
+// as it's drawn, and the scaled texture cache, which samples sizes it has only seen once and copies from cached regions after
+BENCHMARK(scaled_textures) {
+    constexpr int frames = 30;
+    std::mt19937 rng(1234);
+    display::raster_texture textures[] = {
+        random_texture(size<u16>(80, 48), rng, false),
+        random_texture(size<u16>(300, 64), rng, false),
+        random_texture(size<u16>(160, 160), rng, true),
+        random_texture(size<u16>(16, 16), rng, true),
+    };
+    std::vector<scaled_quad> quads = scaled_hub(textures);
+    std::vector<u8> pixels(size_t(screen_width) * screen_height * 4);
+    framebuffer fb(pixels.data(), size<u16>(screen_width, screen_height));
+    display::tiled_rasterizer raster(0);
+    display::scaled_texture_cache cache(32 * 1024 * 1024);
+    u64 frame = 0;
+
+    auto zooming_sprite = [&]() {
+        f32 zoom = 40 + frame % 40;
+        return scaled_quad {&textures[3], 3, rect<i32>(point<i32>(0, 0), size<i32>(16, 16)), point<f32>(900, 500), size<f32>(zoom, zoom)};
+    };
+    std::deque<display::raster_texture> rescaled;
+    f32 before = time_ms(frames, [&]() {
+        frame++;
+        rescaled.clear();
+        raster.begin_frame(fb, true);
+        quads.push_back(zooming_sprite());
+        for (auto& q : quads) {
+            rescaled.emplace_back(rescale_whole_texture(*q.tex, q.quad_size.to<u16>()));
+            point<i32> texel(q.region.origin.x * q.quad_size.x / q.tex->size().x, q.region.origin.y * q.quad_size.y / q.tex->size().y);
+            raster.add(rescaled.back(), texel, q.tl, q.tl + q.quad_size);
+        }
+        quads.pop_back();
+        raster.finish_frame();
+    });
+
+    f32 sampled = time_ms(frames, [&]() {
+        frame++;
+        raster.begin_frame(fb, true);
+        quads.push_back(zooming_sprite());
+        for (auto& q : quads) raster.add_scaled(*q.tex, q.region, q.tl, q.tl + q.quad_size, display::texture_filter::nearest);
+        quads.pop_back();
+        raster.finish_frame();
+    });
+
+    auto cached_frames = [&](display::texture_filter filter) {
+        return time_ms(frames, [&]() {
+            frame++;
+            raster.begin_frame(fb, true);
+            quads.push_back(zooming_sprite());
+            for (auto& q : quads) {
+                display::raster_texture* copy = cache.get(q.texture_id, *q.tex, q.region, q.quad_size.to<u16>(), filter, frame);
+                if (copy) raster.add(*copy, point<i32>(0, 0), q.tl, q.tl + q.quad_size);
+                else raster.add_scaled(*q.tex, q.region, q.tl, q.tl + q.quad_size, filter);
+            }
+            quads.pop_back();
+            raster.finish_frame();
+        });
+    };
+    f32 cached = cached_frames(display::texture_filter::nearest);
+    size_t hits = cache.hits, misses = cache.misses;
+    f32 bilinear = cached_frames(display::texture_filter::bilinear);
+
+    printf("%zu quads, UI at 1.5x\n", quads.size() + 1);
+    printf("rescale per quad : %8.3f ms/frame\n", before);
+    printf("sampled directly : %8.3f ms/frame\n", sampled);
+    printf("cached, nearest  : %8.3f ms/frame, %zu hits, %zu misses, %zu KiB cached\n", cached, hits, misses, cache.bytes_used() / 1024);
+    printf("cached, bilinear : %8.3f ms/frame\n", bilinear);
+}
+
+// A tick of the text atlas with one inventory count redrawn: converting the whole atlas again, as every tick used to,
+// against converting just the strip that changed
+BENCHMARK(texture_updates) {
+    std::mt19937 rng(11);
+    size<u16> atlas_size(400, 1128);
+    std::vector<u8> pixels(size_t(atlas_size.x) * atlas_size.y * 4);
+    for (auto& p : pixels) p = rng();
+    image atlas(pixels, atlas_size);
+    display::raster_texture converted(atlas);
+    rect<i32> strip(point<i32>(0, 480), size<i32>(atlas_size.x, 24));
+
+    f32 whole = time_ms(100, [&]() { converted = display::raster_texture(atlas); });
+    f32 dirty = time_ms(100, [&]() { converted.update(atlas, strip); });
+    printf("whole atlas : %8.3f ms\n", whole);
+    printf("dirty strip : %8.3f ms\n", dirty);
+}
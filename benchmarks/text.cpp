@@ -0,0 +1,118 @@
+#include "benchmark.h"
+#include <engine/ecs.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct text_scene {
+    ecs::pool<ecs::text> texts;
+    ecs::pool<ecs::display> displays;
+    texture atlas {0, image(), size<u16>(1, 1)};
+    ecs::s_text system;
+
+    text_scene() { system.set_texture(&atlas); }
+    void run() { system.run(ecs::view<ecs::text, ecs::display>(texts, displays)); }
+
+    // One widget with a line of text per label, like the inventory grid or a menu
+    void add_labels(entity e, const std::vector<std::string>& labels) {
+        auto& dpy = displays.add(e, ecs::display());
+        dpy.parent = e;
+        auto& text = texts.add(e, ecs::text());
+        text.sprite_index = dpy.add_sprite(labels.size(), nullptr, 0, render_layers::ui);
+        for (size_t i = 0; i < labels.size(); i++) {
+            dpy.sprites(text.sprite_index).set_pos(sprite_coords(0, i * 24), sprite_coords(400, 24), i);
+            text.text_entries.push_back(ecs::text::text_entry {u8(i), labels[i], color(255, 255, 255, 255)});
+        }
+    }
+};
+
+}
+
+// The text atlas through a session in the hub: the HUD and a 40 slot inventory, one item count changing at a time,
+// then the options menu opening on top
+BENCHMARK(text_atlas) {
+    auto scene = std::make_unique<text_scene>();
+    scene->add_labels(0, {"Health 100/100", "Ammo 30", "Hub: Repair Bay"});
+    std::vector<std::string> counts;
+    for (int i = 0; i < 40; i++) counts.push_back("x" + std::to_string(i * 7 % 99));
+    scene->add_labels(1, counts);
+
+    f32 first = time_ms(1, [&]() { scene->run(); });
+    printf("first frame      : %8.3f ms, %zu glyphs rasterized\n", first, scene->system.glyphs_rasterized());
+
+    f32 unchanged = time_ms(100, [&]() { scene->run(); });
+    printf("nothing changed  : %8.3f ms/tick\n", unchanged);
+
+    size_t before = scene->system.glyphs_rasterized();
+    int tick = 0;
+    f32 one_count = time_ms(100, [&]() {
+        auto& slot = scene->texts.get(1).text_entries[tick % 40];
+        slot.text = "x" + std::to_string(tick++ % 99);
+        scene->run();
+    });
+    printf("one count changed: %8.3f ms/tick, %zu glyphs rasterized\n", one_count, scene->system.glyphs_rasterized() - before);
+
+    before = scene->system.glyphs_rasterized();
+    f32 menu = time_ms(1, [&]() {
+        scene->add_labels(2, {"OPTIONS", "Resolution", "Fullscreen", "VSync", "Music volume", "Effects volume", "Back"});
+        scene->run();
+    });
+    printf("options opened   : %8.3f ms, %zu glyphs rasterized\n", menu, scene->system.glyphs_rasterized() - before);
+}
+
+// Building the options menu: every label is measured to size its widget, then drawn, and the widest of a group is
+// measured again to line the group up
+BENCHMARK(text_shaping) {
+    auto scene = std::make_unique<text_scene>();
+    std::vector<std::string> labels = {"GRAPHICSMENU_FULLSCREEN_CONTROL", "GRAPHICSMENU_VSYNC_CONTROL", "GRAPHICSMENU_WINDOWRES_CONTROL",
+                                       "GRAPHICSMENU_RENDERER_CONTROL", "DARTH_PLAGUEIS_COPYPASTA"};
+    f32 build = time_ms(1, [&]() {
+        for (int pass = 0; pass < 3; pass++) {
+            for (auto& label : labels) scene->system.get_text_size(label);
+        }
+        scene->add_labels(0, labels);
+        scene->run();
+    });
+    printf("menu built       : %8.3f ms, %zu strings shaped\n", build, scene->system.strings_shaped());
+
+    f32 measure = time_ms(1000, [&]() {
+        for (auto& label : labels) scene->system.get_text_size(label);
+    });
+    printf("measure %zu labels : %8.3f ms, %zu strings shaped\n", labels.size(), measure, scene->system.strings_shaped());
+}
+
+// resize_ui scaling every text sprite by 1.25, then a menu opening. Coverage text is drawn again into a bigger atlas to
+// fill them, while distance field text keeps its unscaled strips, through the menu's relayout too, and is stretched by
+// the renderer.
+BENCHMARK(text_ui_scale) {
+    for (bool distance_field : {false, true}) {
+        auto scene = std::make_unique<text_scene>();
+        scene->system.set_distance_field(distance_field);
+        std::vector<std::string> counts;
+        for (int i = 0; i < 40; i++) counts.push_back("x" + std::to_string(i * 7 % 99));
+        scene->add_labels(0, counts);
+        scene->add_labels(1, {"OPTIONS", "Resolution", "Fullscreen", "VSync", "Music volume", "Effects volume", "Back"});
+        scene->run();
+
+        f32 rescale = time_ms(1, [&]() {
+            for (auto [text, dpy] : ecs::view<ecs::text, ecs::display>(scene->texts, scene->displays)) {
+                sprite_data& sprite = dpy.sprites(text.sprite_index);
+                for (int i = 0; i < sprite.num_quads(); i++) {
+                    rect<f32> dim = sprite.get_dimensions(i);
+                    sprite.set_pos(dim.origin * 1.25f, dim.size * 1.25f, i);
+                }
+            }
+            scene->run();
+        });
+        size_t scaled_atlas = scene->atlas.image_data.data().size();
+        f32 menu = time_ms(1, [&]() {
+            scene->add_labels(2, {"Fullscreen", "VSync", "Back"});
+            scene->run();
+        });
+        printf("%-14s: rescale %8.3f ms, atlas %6zu KiB, menu opened %8.3f ms, atlas %6zu KiB\n",
+               distance_field ? "distance field" : "coverage", rescale, scaled_atlas / 1024, menu,
+               scene->atlas.image_data.data().size() / 1024);
+    }
+}
@@ -0,0 +1,40 @@
+#include "benchmark.h"
+#include <ui/ui.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Bytes currently allocated from the heap, where the C library can say
+size_t heap_in_use() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+}
+
+// Typing into a text box, one character per tick. Every keystroke measures the text, finds where its characters start
+// and moves the cursor, then the text system redraws the box.
+BENCHMARK(textinput_typing) {
+    engine g;
+    entity e = g.create_entity();
+    add_textinput(e, g.ui.root, 5, g, point<f32>(100, 100), sprite_coords(1200, 32));
+    g.run_tick();
+
+    const std::string typed = "The quick brown fox jumps over the lazy dog. ";
+    size_t heap_before = heap_in_use();
+    f32 typing = time_ms(1000, [&, i = 0]() mutable {
+        textinput_event(e, g, std::string(1, typed[i++ % typed.size()]));
+        g.run_tick();
+    });
+    size_t heap_after = heap_in_use();
+
+    printf("1000 characters typed: %8.3f ms/keystroke\n", typing);
+#ifdef __GLIBC__
+    printf("heap growth          : %8.1f KiB\n", (double(heap_after) - heap_before) / 1024.0);
+#endif
+}
@@ -0,0 +1,75 @@
+#include "benchmark.h"
+#include <engine/render_list.h>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+constexpr int map_tiles = 1024;
+constexpr int chunk_tiles = 32;
+
+// The same 1024x1024 map laid out the old way, as one sprite with a quad per tile, and as 32x32 tile static chunks
+std::vector<sprite_data> build_map(texture& tex, int chunk_size) {
+    std::vector<sprite_data> sprites;
+    int chunks = map_tiles / chunk_size;
+    for (int c = 0; c < chunks * chunks; c++) {
+        sprites.emplace_back(chunk_size * chunk_size, &tex, 0, render_layers::sprites);
+        sprites.back().static_geometry = chunk_size != map_tiles;
+    }
+    for (int y = 0; y < map_tiles; y++) {
+        for (int x = 0; x < map_tiles; x++) {
+            sprite_data& chunk = sprites[(x / chunk_size) + (y / chunk_size) * chunks];
+            size_t quad = (x % chunk_size) + (y % chunk_size) * chunk_size;
+            chunk.set_pos(sprite_coords(x, y), sprite_coords(1, 1), quad);
+            chunk.set_uv(point<f32>(0, 0), size<f32>(0.2, 0.33), quad);
+        }
+    }
+    return sprites;
+}
+
+// The CPU side of a frame, the way engine::run_tick and renderer::render_layer see it. Batched quads are copied into an
+// upload buffer, while static sprites off screen are skipped and the rest drawn from GPU memory without copying.
+struct frame_stats {
+    size_t quads_uploaded = 0;
+    size_t static_drawn = 0;
+};
+
+frame_stats run_frame(display::render_list& list, std::vector<sprite_data>& sprites, std::vector<quad_instance>& upload, rect<f32> camera) {
+    frame_stats stats;
+    list.begin_submission();
+    for (auto& sprite : sprites) list.submit(sprite, nullptr);
+    list.end_submission();
+    for (u32 handle : list.draw_order()) {
+        if (list.get(handle).static_geometry) {
+            if (AABB_collision(list.bounds(handle), camera)) stats.static_drawn++;
+            continue;
+        }
+        const std::vector<quad_instance>& instances = list.instances(handle);
+        memcpy(upload.data(), instances.data(), instances.size() * sizeof(quad_instance));
+        stats.quads_uploaded += instances.size();
+    }
+    return stats;
+}
+
+}
+
+// A 1080p camera panning over a 1024x1024 tile map. Before: the whole map as one sprite, copied for upload every frame.
+// After: static 32x32 chunks, culled against the camera, with nothing to upload once they're on the GPU.
+BENCHMARK(tilemap) {
+    texture tex {0, image(), size<u16>(1, 1)};
+    std::vector<quad_instance> upload(map_tiles * map_tiles);
+    for (int chunk_size : {map_tiles, chunk_tiles}) {
+        std::vector<sprite_data> sprites = build_map(tex, chunk_size);
+        display::render_list list;
+        run_frame(list, sprites, upload, rect<f32>());
+
+        frame_stats stats;
+        rect<f32> camera(point<f32>(100, 100), size<f32>(1920 / 64.0f, 1080 / 64.0f));
+        f32 ms = time_ms(50, [&]() {
+            camera.origin.x += 0.5f;
+            stats = run_frame(list, sprites, upload, camera);
+        });
+        printf("%dx%d map, %-20s: %8.3f ms/frame, %8zu quads uploaded, %3zu static chunks drawn\n", map_tiles, map_tiles,
+               chunk_size == map_tiles ? "one sprite" : "32x32 static chunks", ms, stats.quads_uploaded, stats.static_drawn);
+    }
+}
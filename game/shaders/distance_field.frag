@@ -0,0 +1,14 @@
+#version 120
+
+uniform sampler2D tex;
+varying vec2 uv_out;
+
+// Alpha is the distance to the glyph's edge, 0.5 right on it. The edge is smoothed over one pixel on screen, however far
+// the texture is scaled.
+void main()
+{
+    vec4 texel = texture2D(tex, uv_out);
+    float edge_width = 0.5 * fwidth(texel.a);
+    float coverage = smoothstep(0.5 - edge_width, 0.5 + edge_width, texel.a);
+    gl_FragColor = vec4(texel.rgb, coverage);
+};
@@ -2,14 +2,21 @@
 
 uniform vec2 viewport;
 
-attribute vec3 pos;
-attribute vec2 uv;
+attribute vec2 corner;
+attribute vec2 center;
+attribute vec2 quad_size;
+attribute float rotation;
+attribute vec4 uv_rect;
 attribute float z_index;
 
 varying vec2 uv_out;
 
 void main()
 {
+	vec2 local = (corner - 0.5) * quad_size;
+	float s = sin(rotation);
+	float c = cos(rotation);
+	vec2 pos = center + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
 	gl_Position =  vec4(pos.x * viewport.x - 1.0, pos.y  * -viewport.y + 1.0, 0.9 - (z_index / 10), 1);
-    uv_out = uv;
+    uv_out = mix(uv_rect.xy, uv_rect.zw, corner);
 };
\ No newline at end of file
@@ -145,8 +145,13 @@ struct no_move {
 	no_move& operator = (no_move&&) = delete;
 };
 
+// Entity handles pack a 16 bit index into the component pools with a 16 bit generation above it.
+// The generation is bumped each time an index is recycled, so handles to destroyed entities can be detected.
 using entity = u32;
 constexpr static entity null_entity = 65535;
+constexpr u32 entity_index(entity e) { return e & 0xFFFF; }
+constexpr u32 entity_generation(entity e) { return e >> 16; }
+constexpr entity make_entity(u32 index, u32 generation) { return (generation << 16) | index; }
 
 class timer {
 	std::chrono::steady_clock::time_point _start;
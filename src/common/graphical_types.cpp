@@ -1,13 +1,37 @@
 #include "graphical_types.h"
 #include <cmath>
+#include <algorithm>
 #define VERTICES_PER_QUAD 4
 
+// Past this many areas, a texture's changes are merged into the one area covering all of them
+static constexpr size_t max_dirty_areas = 16;
+
+void texture::mark_dirty(rect<u16> area) {
+    if (dirty_whole || area.size.x == 0 || area.size.y == 0) return;
+    for (rect<u16>& existing : dirty_areas) {
+        if (existing.origin == area.origin && existing.size == area.size) return;
+    }
+    if (dirty_areas.size() < max_dirty_areas) {
+        dirty_areas.push_back(area);
+        return;
+    }
+
+    point<u16> tl = area.origin;
+    point<u16> br = area.bottom_right();
+    for (rect<u16>& existing : dirty_areas) {
+        tl = point<u16>(std::min(tl.x, existing.origin.x), std::min(tl.y, existing.origin.y));
+        br = point<u16>(std::max(br.x, existing.bottom_right().x), std::max(br.y, existing.bottom_right().y));
+    }
+    dirty_areas.assign(1, rect<u16>(tl, br - tl));
+}
+
 // Rotate sprite by an angle in radians. For proper rotation, origin needs to be in the center of the object.
 void sprite_data::rotate(f32 theta) {
     f32 s = sin(theta);
     f32 c = cos(theta);
     rect<f32> dimensions = get_dimensions();
     sprite_coords center = dimensions.center();
+    _revision++;
     for (auto& vert : _vertices) {
         f32 i = vert.pos.x - center.x;
         f32 j = vert.pos.y - center.y;
@@ -19,6 +43,7 @@ void sprite_data::rotate(f32 theta) {
 void sprite_data::set_pos(sprite_coords pos, sprite_coords size, size_t quad) {
     // Vertices are in order top left, top right, bottom right, and bottom left
     size_t index = (quad) * VERTICES_PER_QUAD;
+    _revision++;
     _vertices[index].pos = pos;
     _vertices[index + 1].pos = sprite_coords(pos.x + size.x, pos.y);
     _vertices[index + 2].pos = pos + sprite_coords(size.x, size.y);
@@ -26,8 +51,14 @@ void sprite_data::set_pos(sprite_coords pos, sprite_coords size, size_t quad) {
 }
 
 void sprite_data::set_uv(point<f32> pos, size<f32> size, size_t quad) {
+    // UVs are given relative to the texture, so textures packed into an atlas are mapped into their area of the page
+    if (tex != nullptr && tex->page != nullptr) {
+        pos = tex->page_uv.origin + pos * tex->page_uv.size;
+        size = size * tex->page_uv.size;
+    }
     // Vertices are in order top left, top right, bottom right, and bottom left
     size_t index = (quad) * VERTICES_PER_QUAD;
+    _revision++;
     _vertices[index].uv = pos;
     _vertices[index + 1].uv = point<f32>(pos.x + size.x, pos.y);
     _vertices[index + 2].uv = pos + point<f32>(size.x, size.y);
@@ -37,12 +68,7 @@ void sprite_data::set_uv(point<f32> pos, size<f32> size, size_t quad) {
 void sprite_data::set_tex_region(size_t tex_index, size_t quad) {
     ::size<f32> region_size(1.0f / tex->regions.x, 1.0f / tex->regions.y);
     ::size<f32> pos = region_size * ::size<f32>(tex_index % tex->regions.x, tex_index / tex->regions.x);
-    // Vertices are in order top left, top right, bottom right, and bottom left
-    size_t index = (quad) * VERTICES_PER_QUAD;
-    _vertices[index].uv = pos;
-    _vertices[index + 1].uv = point<f32>(pos.x + region_size.x, pos.y);
-    _vertices[index + 2].uv = pos + point<f32>(region_size.x, region_size.y);
-    _vertices[index + 3].uv = point<f32>(pos.x, pos.y + region_size.y);
+    set_uv(pos, region_size, quad);
 }
 
 void sprite_data::move_to(sprite_coords pos) {
@@ -51,11 +77,24 @@ void sprite_data::move_to(sprite_coords pos) {
 }
 
 void sprite_data::move_by(sprite_coords change) {
+    _revision++;
     for (auto& vert : _vertices) {
         vert.pos += change;
     }
 }
 
+// Take vertices from an entity's local space into the world: scale, then rotate about the local origin, then move to position.
+void sprite_data::apply_transform(sprite_coords position, f32 rotation, sprite_coords scale) {
+    f32 s = sin(rotation);
+    f32 c = cos(rotation);
+    _revision++;
+    for (auto& vert : _vertices) {
+        f32 i = vert.pos.x * scale.x;
+        f32 j = vert.pos.y * scale.y;
+        vert.pos.x = ((i * c) - (j * s)) + position.x;
+        vert.pos.y = ((i * s) + (j * c)) + position.y;
+    }
+}
 
 rect<f32> sprite_data::get_dimensions(u8 quad_index) {
     sprite_coords min(65535, 65535);
@@ -78,4 +117,25 @@ rect<f32> sprite_data::get_dimensions(u8 quad_index) {
     }
 
     return rect<f32>(min, max - min);
-}
\ No newline at end of file
+}
+// Quads are stored as their corners, in order top left, top right, bottom right, and bottom left. The top edge gives the
+// rotation and width. Height is measured along the rotated vertical axis, so mirrored quads get a negative height.
+quad_instance quad_instance::from_vertices(const vertex* quad, u8 z_index) {
+    sprite_coords across = quad[1].pos - quad[0].pos;
+    sprite_coords down = quad[3].pos - quad[0].pos;
+    f32 rotation = atan2(across.y, across.x);
+    f32 s = sin(rotation);
+    f32 c = cos(rotation);
+
+    auto normalize = [](f32 uv) { return u16(std::clamp(uv, 0.0f, 1.0f) * 65535.0f + 0.5f); };
+    quad_instance instance;
+    instance.center = (quad[0].pos + quad[2].pos) * 0.5f;
+    instance.size = ::size<f32>(sqrt(across.x * across.x + across.y * across.y), down.y * c - down.x * s);
+    instance.rotation = rotation;
+    instance.z_index = z_index;
+    instance.uv_origin[0] = normalize(quad[0].uv.x);
+    instance.uv_origin[1] = normalize(quad[0].uv.y);
+    instance.uv_end[0] = normalize(quad[2].uv.x);
+    instance.uv_end[1] = normalize(quad[2].uv.y);
+    return instance;
+}
@@ -8,6 +8,8 @@ struct color {
     u8 r, g, b, a;
     color() = default;
     color(u8 r_in, u8 g_in, u8 b_in, u8 a_in) : r(r_in), g(g_in), b(b_in), a(a_in) {}
+    bool operator==(const color& rhs) const { return r == rhs.r && g == rhs.g && b == rhs.b && a == rhs.a; }
+    bool operator!=(const color& rhs) const { return !(*this == rhs); }
 };
 
 template <typename T>
@@ -44,13 +46,56 @@ struct vertex {
     point<f32> uv;
 };
 
+// One quad as the renderers consume it: a rectangle rotated about its center, and the texture area it shows.
+// The texture area is normalized to the full range of u16, which is plenty for any atlas page.
+struct quad_instance {
+    sprite_coords center;
+    ::size<f32> size;
+    f32 rotation;
+    f32 z_index;
+    // UVs at the quad's first and third corners. uv_end is less than uv_origin along any axis the texture is flipped on.
+    u16 uv_origin[2];
+    u16 uv_end[2];
+
+    static quad_instance from_vertices(const vertex* quad, u8 z_index);
+    point<f32> uv_tl() const { return point<f32>(uv_origin[0], uv_origin[1]) / 65535.0f; }
+    point<f32> uv_br() const { return point<f32>(uv_end[0], uv_end[1]) / 65535.0f; }
+    // Whether the quad can be drawn as an axis aligned rectangle from uv_tl to uv_br
+    bool axis_aligned() const { return rotation == 0 && size.x > 0 && size.y > 0 && uv_end[0] >= uv_origin[0] && uv_end[1] >= uv_origin[1]; }
+};
+static_assert(sizeof(quad_instance) == 32, "quad instances are uploaded as 32 byte records");
+
+// Distance field textures keep the signed distance to the nearest edge in their alpha channel, as FreeType writes it:
+// 128 on the edge, and 128 / distance_field_spread more for every texel further inside
+constexpr u8 distance_field_spread = 4;
+
 struct texture {
     u32 id;
     image image_data;
     size<u16> regions;
+    // Textures packed into an atlas draw from their area of the page, and have no pixels of their own
+    texture* page = nullptr;
+    rect<f32> page_uv {point<f32>(0, 0), ::size<f32>(1, 1)};
+    // Alpha is distance rather than coverage, and renderers turn it into coverage at whatever size the texture is drawn.
+    // Only drawn on screen space layers.
+    bool distance_field = false;
+    // What changed in image_data since the texture manager last took it in. Textures start out whole, and are marked
+    // whole again when their image is replaced. Unchanged textures are skipped entirely.
+    bool dirty_whole = true;
+    std::vector<rect<u16>> dirty_areas {};
+
+    texture* bound_texture() { return page == nullptr ? this : page; }
+    bool dirty() { return dirty_whole || !dirty_areas.empty(); }
+    void mark_dirty(rect<u16> area);
+    void mark_dirty() { dirty_whole = true; }
+    void mark_clean() {
+        dirty_whole = false;
+        dirty_areas.clear();
+    }
 };
 
 
+// Generators mark what they draw into their texture as they go, so the texture manager only uploads what changed
 class texture_generator {
 public:
     void set_texture(texture *in) {
@@ -60,6 +105,10 @@ public:
 
     texture* get_texture() { return tex; }
 protected:
+    void mark_dirty(rect<u16> area) { tex->mark_dirty(area); }
+    // For when the image is replaced, like when the atlas is laid out again
+    void mark_replaced() { tex->mark_dirty(); }
+
     size_t last_atlassize = 0;
     texture* tex;
     bool regenerate = true;
@@ -80,6 +129,8 @@ struct sprite_data {
     texture* tex = nullptr;
     u8 z_index = 1;
     render_layers layer;
+    u32 render_handle = ~0u; // Slot in the renderer's render_list, see render_list::submit
+    bool static_geometry = false; // Rarely changes, so renderers may keep its quads in GPU memory between frames
 
     sprite_data(size_t num_quads, texture * tex_in, int z_index_in, render_layers layer_in) {
         _vertices = std::vector<vertex>(num_quads * vertices_per_quad);
@@ -89,6 +140,7 @@ struct sprite_data {
     }
 
     const std::vector<vertex>& vertices() const { return _vertices; };
+    u32 revision() const { return _revision; } // Bumped whenever vertex positions or UVs change
     int num_quads() { return _vertices.size() / 4; };
     rect<f32> get_dimensions(u8 quad_index = 255);
 
@@ -98,15 +150,18 @@ struct sprite_data {
     void rotate(f32 theta);
     void move_by(sprite_coords);
     void move_to(sprite_coords);
+    void apply_transform(sprite_coords position, f32 rotation, sprite_coords scale);
 
-    inline bool operator < (const sprite_data& rhs ) const {
-        if (layer < rhs.layer) return true;
-        if (z_index < rhs.z_index) return true;
-        if (tex->id < rhs.tex->id) return true;
-        return false;
+    // Draw order packed into one integer, most significant first: layer, z index, bound texture id, then material.
+    // Nothing uses materials yet, so those bits are zero.
+    u64 sort_key() const {
+        u64 tex_id = tex == nullptr ? 0 : tex->bound_texture()->id;
+        return (u64(layer) << 56) | (u64(z_index) << 48) | ((tex_id & 0xFFFFFFFF) << 16);
     }
+    inline bool operator < (const sprite_data& rhs ) const { return sort_key() < rhs.sort_key(); }
 private:
     std::vector<vertex> _vertices {};
+    u32 _revision = 0;
 };
 
 
@@ -0,0 +1,101 @@
+#ifndef PAGED_STORAGE_H
+#define PAGED_STORAGE_H
+
+#include "basic_types.h"
+#include <array>
+#include <memory>
+#include <vector>
+
+// A growable marked_storage. Elements live in fixed pages of 64, each with a single presence word,
+// so iteration skips empty ranges a word at a time. Pages are allocated the first time an element lands in them
+// and are never moved, so references to elements stay valid while the storage grows.
+template <typename element>
+class paged_storage {
+public:
+	static constexpr size_t page_size = 64;
+private:
+	struct page {
+		u64 markers = 0;
+		std::array<element, page_size> container;
+	};
+	std::vector<std::unique_ptr<page>> _pages;
+	size_t _count = 0;
+
+	u64 page_markers(size_t page_index) const {
+		return _pages[page_index] ? _pages[page_index]->markers : 0;
+	}
+public:
+	bool exists(const size_t id) const {
+		size_t page_index = id / page_size;
+		return page_index < _pages.size() && (page_markers(page_index) & (1ull << (id % page_size))) != 0;
+	}
+	// To avoid extraneous testing, no validity checks are performed here
+	element& get(const size_t id) { return _pages[id / page_size]->container[id % page_size]; }
+	const element& get(const size_t id) const { return _pages[id / page_size]->container[id % page_size]; }
+	void remove(const size_t id) {
+		if (!exists(id)) return;
+		_pages[id / page_size]->markers &= ~(1ull << (id % page_size));
+		_count--;
+	}
+	element& add(const size_t id, const element e) {
+		size_t page_index = id / page_size;
+		if (page_index >= _pages.size()) _pages.resize(page_index + 1);
+		if (!_pages[page_index]) _pages[page_index] = std::make_unique<page>();
+
+		page& p = *_pages[page_index];
+		u64 bit = 1ull << (id % page_size);
+		if ((p.markers & bit) == 0) _count++;
+		p.markers |= bit;
+		p.container[id % page_size] = e;
+		return p.container[id % page_size];
+	}
+	size_t size() const { return _count; }
+	size_t capacity() const { return _pages.size() * page_size; }
+	// Presence bits for ids [word * 64, word * 64 + 64), for joining several storages a word at a time
+	size_t num_words() const { return _pages.size(); }
+	u64 presence_word(size_t word) const { return page_markers(word); }
+
+	class iterator;
+	iterator begin() { return iterator(0, this); }
+	iterator end() { return iterator(capacity(), this); }
+
+	class iterator {
+	public:
+		iterator(size_t index, paged_storage* store): _store(store) { seek(index); }
+		iterator operator++() {
+			// Clear the current element's bit, and take the next one from the same word when possible
+			_bits &= _bits - 1;
+			if (_bits != 0) _index = (_index & ~(page_size - 1)) + __builtin_ctzll(_bits);
+			else seek((_index & ~(page_size - 1)) + page_size);
+			return *this;
+		}
+
+		size_t index() { return _index; }
+		// Compared by ordering rather than equality, so adding pages mid-iteration can't run past a cached end()
+		bool operator!=(const iterator & other) const { return _index < other._index; }
+		element& operator*() { return _store->get(_index); }
+	private:
+		size_t _index;
+		u64 _bits = 0; // Elements of the current page not yet visited, including the current one
+		paged_storage* _store;
+
+		// Move to the first element at or after from, a presence word at a time
+		void seek(size_t from) {
+			size_t page_index = from / page_size;
+			u64 mask = ~0ull << (from % page_size);
+			while (page_index < _store->_pages.size()) {
+				_bits = _store->page_markers(page_index) & mask;
+				if (_bits != 0) {
+					_index = page_index * page_size + __builtin_ctzll(_bits);
+					return;
+				}
+				page_index++;
+				mask = ~0ull;
+			}
+			_index = _store->capacity();
+		}
+		friend class paged_storage;
+	};
+};
+
+#endif //PAGED_STORAGE_H
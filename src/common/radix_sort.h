@@ -0,0 +1,40 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "basic_types.h"
+#include <array>
+#include <vector>
+
+// Stable LSD radix sort on a 64-bit key, a byte per pass. All eight byte histograms are counted in a single read,
+// and passes where every key has the same byte are skipped, so keys that only use a few bytes only pay for those.
+// scratch is resized to match items and can be kept between calls to avoid allocating.
+template <typename T, typename F>
+void radix_sort(std::vector<T>& items, std::vector<T>& scratch, F&& key_of) {
+	constexpr size_t passes = sizeof(u64);
+	std::array<std::array<u32, 256>, passes> counts {};
+	for (const T& item : items) {
+		u64 key = key_of(item);
+		for (size_t pass = 0; pass < passes; pass++) counts[pass][(key >> (pass * 8)) & 0xFF]++;
+	}
+
+	scratch.resize(items.size());
+	std::vector<T>* from = &items;
+	std::vector<T>* to = &scratch;
+	for (size_t pass = 0; pass < passes; pass++) {
+		std::array<u32, 256>& count = counts[pass];
+		u64 first_byte = items.empty() ? 0 : (key_of(items[0]) >> (pass * 8)) & 0xFF;
+		if (count[first_byte] == items.size()) continue;
+
+		u32 offset = 0;
+		for (u32& c : count) {
+			u32 bucket_size = c;
+			c = offset;
+			offset += bucket_size;
+		}
+		for (const T& item : *from) (*to)[count[(key_of(item) >> (pass * 8)) & 0xFF]++] = item;
+		std::swap(from, to);
+	}
+	if (from != &items) items.swap(scratch);
+}
+
+#endif //RADIX_SORT_H
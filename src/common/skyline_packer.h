@@ -0,0 +1,85 @@
+#ifndef SKYLINE_PACKER_H
+#define SKYLINE_PACKER_H
+
+#include "basic_types.h"
+#include <algorithm>
+#include <vector>
+
+// Packs rectangles into a fixed size page, tracking the top edge of everything placed so far as a skyline of segments.
+// Each rectangle goes wherever its top edge ends up lowest, ties going to the narrower segment, so taller rectangles
+// should be inserted first.
+class skyline_packer {
+public:
+	explicit skyline_packer(size<u16> page_size) : _page_size(page_size) { skyline.push_back(segment {0, 0, page_size.x}); }
+
+	// Returns false when there's no room left for a rectangle of this size
+	bool insert(size<u16> rect_size, point<u16>& position) {
+		size_t best = skyline.size();
+		u32 best_top = ~0u;
+		u32 best_width = ~0u;
+		for (size_t i = 0; i < skyline.size(); i++) {
+			u32 y = 0;
+			if (!fit(i, rect_size, y)) continue;
+			u32 top = y + rect_size.y;
+			if (top < best_top || (top == best_top && skyline[i].width < best_width)) {
+				best = i;
+				best_top = top;
+				best_width = skyline[i].width;
+			}
+		}
+		if (best == skyline.size()) return false;
+
+		position = point<u16>(skyline[best].x, best_top - rect_size.y);
+		place(best, segment {position.x, u16(best_top), rect_size.x});
+		return true;
+	}
+
+	size<u16> page_size() { return _page_size; }
+private:
+	struct segment {
+		u16 x, y, width;
+	};
+	std::vector<segment> skyline;
+	size<u16> _page_size;
+
+	// A rectangle starting at segment i rests on the highest segment it spans
+	bool fit(size_t i, size<u16> rect_size, u32& y) {
+		if (u32(skyline[i].x) + rect_size.x > _page_size.x) return false;
+		u32 width_left = rect_size.x;
+		y = skyline[i].y;
+		for (; width_left > 0; i++) {
+			if (i == skyline.size()) return false;
+			y = std::max<u32>(y, skyline[i].y);
+			if (y + rect_size.y > _page_size.y) return false;
+			width_left -= std::min<u32>(width_left, skyline[i].width);
+		}
+		return true;
+	}
+
+	// Insert the new top edge, cut away the segments it covers, and join neighbours of equal height
+	void place(size_t i, segment top) {
+		skyline.insert(skyline.begin() + i, top);
+		u32 covered_to = u32(top.x) + top.width;
+		while (i + 1 < skyline.size() && skyline[i + 1].x < covered_to) {
+			segment& next = skyline[i + 1];
+			u32 next_end = u32(next.x) + next.width;
+			if (next_end <= covered_to) {
+				skyline.erase(skyline.begin() + i + 1);
+				continue;
+			}
+			next.width = next_end - covered_to;
+			next.x = covered_to;
+			break;
+		}
+		for (size_t j = 0; j + 1 < skyline.size();) {
+			if (skyline[j].y == skyline[j + 1].y) {
+				skyline[j].width += skyline[j + 1].width;
+				skyline.erase(skyline.begin() + j + 1);
+			} else {
+				j++;
+			}
+		}
+	}
+};
+
+#endif //SKYLINE_PACKER_H
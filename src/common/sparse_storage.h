@@ -0,0 +1,74 @@
+#ifndef SPARSE_STORAGE_H
+#define SPARSE_STORAGE_H
+
+#include "basic_types.h"
+#include <vector>
+
+// Sparse set with the same interface as paged_storage. A sparse index maps ids to positions in a densely packed
+// element array, so iteration only touches live elements and memory scales with the number of elements stored.
+// Removal swaps the last element into the hole, so unlike paged_storage, references are invalidated by add and remove.
+template <typename element>
+class sparse_storage {
+private:
+	static constexpr u32 npos = ~0u;
+	std::vector<u32> _sparse; // id -> position in _dense, or npos
+	std::vector<element> _dense;
+	std::vector<u32> _ids; // position in _dense -> id
+	std::vector<u64> _presence; // One bit per id, for joining with other storages a word at a time
+public:
+	bool exists(const size_t id) const { return id < _sparse.size() && _sparse[id] != npos; }
+	// To avoid extraneous testing, no validity checks are performed here
+	element& get(const size_t id) { return _dense[_sparse[id]]; }
+	const element& get(const size_t id) const { return _dense[_sparse[id]]; }
+	void remove(const size_t id) {
+		if (!exists(id)) return;
+		u32 position = _sparse[id];
+		if (position != _dense.size() - 1) {
+			_dense[position] = std::move(_dense.back());
+			_ids[position] = _ids.back();
+			_sparse[_ids[position]] = position;
+		}
+		_dense.pop_back();
+		_ids.pop_back();
+		_sparse[id] = npos;
+		_presence[id / 64] &= ~(1ull << (id % 64));
+	}
+	element& add(const size_t id, const element e) {
+		if (exists(id)) return get(id) = e;
+		if (id >= _sparse.size()) {
+			_sparse.resize(id + 1, npos);
+			_presence.resize(id / 64 + 1, 0);
+		}
+		_sparse[id] = _dense.size();
+		_presence[id / 64] |= 1ull << (id % 64);
+		_dense.push_back(e);
+		_ids.push_back(id);
+		return _dense.back();
+	}
+	size_t size() const { return _dense.size(); }
+	size_t num_words() const { return _presence.size(); }
+	u64 presence_word(size_t word) const { return _presence[word]; }
+
+	class iterator;
+	iterator begin() { return iterator(0, this); }
+	iterator end() { return iterator(_dense.size(), this); }
+
+	// Walks the dense array in storage order, which is not id order
+	class iterator {
+	public:
+		iterator(size_t position, sparse_storage* store): _position(position), _store(store) {}
+		iterator operator++() {
+			_position++;
+			return *this;
+		}
+
+		size_t index() { return _store->_ids[_position]; }
+		bool operator!=(const iterator & other) const { return _position < other._position; }
+		element& operator*() { return _store->_dense[_position]; }
+	private:
+		size_t _position;
+		sparse_storage* _store;
+	};
+};
+
+#endif //SPARSE_STORAGE_H
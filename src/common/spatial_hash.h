@@ -0,0 +1,112 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include "basic_types.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Uniform grid broad phase, keyed on world tile coordinates.
+// Every inserted rectangle is registered in each cell it touches. The grid is rebuilt from scratch every tick,
+// and the backing vectors keep their capacity, so a steady-state tick doesn't allocate.
+class spatial_hash {
+public:
+	explicit spatial_hash(f32 cell_size_in = 2.0f) : cell_size(cell_size_in) {}
+
+	void clear() {
+		items.clear();
+		cells.clear();
+		sorted = true;
+	}
+
+	void insert(entity id, rect<f32> bounds) {
+		u32 item_index = items.size();
+		items.push_back(item {id, bounds});
+		point<i32> min = cell_of(bounds.origin);
+		point<i32> max = cell_of(bounds.bottom_right());
+		for (i32 y = min.y; y <= max.y; y++) {
+			for (i32 x = min.x; x <= max.x; x++) {
+				cells.push_back(cell_entry {key_of(x, y), item_index});
+			}
+		}
+		sorted = false;
+	}
+
+	// Calls func(a, b) once for every pair of inserted entities whose rectangles overlap. a is always the lower ID.
+	template <typename F>
+	void for_each_pair(F&& func) {
+		sort_cells();
+		size_t run_start = 0;
+		while (run_start < cells.size()) {
+			size_t run_end = run_start + 1;
+			while (run_end < cells.size() && cells[run_end].key == cells[run_start].key) run_end++;
+
+			for (size_t i = run_start; i < run_end; i++) {
+				item& a = items[cells[i].item_index];
+				for (size_t j = i + 1; j < run_end; j++) {
+					item& b = items[cells[j].item_index];
+					if (!AABB_collision(a.bounds, b.bounds)) continue;
+					// Pairs sharing several cells are only reported from the cell holding the corner of their overlap
+					point<f32> overlap(std::max(a.bounds.origin.x, b.bounds.origin.x), std::max(a.bounds.origin.y, b.bounds.origin.y));
+					point<i32> owner = cell_of(overlap);
+					if (key_of(owner.x, owner.y) != cells[i].key) continue;
+
+					if (a.id < b.id) func(a.id, b.id);
+					else func(b.id, a.id);
+				}
+			}
+			run_start = run_end;
+		}
+	}
+
+	// Calls func(id) once for every inserted entity whose rectangle overlaps the query rectangle.
+	template <typename F>
+	void query(rect<f32> area, F&& func) {
+		sort_cells();
+		point<i32> min = cell_of(area.origin);
+		point<i32> max = cell_of(area.bottom_right());
+		for (i32 y = min.y; y <= max.y; y++) {
+			for (i32 x = min.x; x <= max.x; x++) {
+				u64 key = key_of(x, y);
+				auto it = std::lower_bound(cells.begin(), cells.end(), key, [](const cell_entry& c, u64 k) { return c.key < k; });
+				for (; it != cells.end() && it->key == key; it++) {
+					item& candidate = items[it->item_index];
+					if (!AABB_collision(area, candidate.bounds)) continue;
+					// Report each entity only from the first query cell it shares with the area
+					point<f32> overlap(std::max(area.origin.x, candidate.bounds.origin.x), std::max(area.origin.y, candidate.bounds.origin.y));
+					point<i32> owner = cell_of(overlap);
+					if (owner.x != x || owner.y != y) continue;
+					func(candidate.id);
+				}
+			}
+		}
+	}
+
+	size_t num_items() { return items.size(); }
+private:
+	struct item {
+		entity id;
+		rect<f32> bounds;
+	};
+	struct cell_entry {
+		u64 key;
+		u32 item_index;
+	};
+
+	f32 cell_size;
+	bool sorted = true;
+	std::vector<item> items;
+	std::vector<cell_entry> cells;
+
+	point<i32> cell_of(point<f32> pos) { return point<i32>(std::floor(pos.x / cell_size), std::floor(pos.y / cell_size)); }
+	static u64 key_of(i32 x, i32 y) { return (u64(u32(y)) << 32) | u32(x); }
+	void sort_cells() {
+		if (sorted) return;
+		std::sort(cells.begin(), cells.end(), [](const cell_entry& a, const cell_entry& b) {
+			return a.key < b.key || (a.key == b.key && a.item_index < b.item_index);
+		});
+		sorted = true;
+	}
+};
+
+#endif //SPATIAL_HASH_H
@@ -0,0 +1,91 @@
+#include "thread_pool.h"
+
+namespace {
+// Which pool the current thread works for, and its queue in that pool
+thread_local thread_pool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+}
+
+thread_pool::thread_pool(size_t num_workers) {
+    for (size_t i = 0; i < num_workers + 1; i++) {
+        queues.push_back(std::make_unique<queue>());
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    task_added.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+size_t thread_pool::home_queue() { return current_pool == this ? current_queue : no_queue; }
+
+void thread_pool::submit(std::function<void()> task) {
+    if (deterministic) {
+        task();
+        return;
+    }
+    size_t home = home_queue();
+    queue& q = *queues[home != no_queue ? home : next_queue++ % queues.size()];
+    {
+        // Counted before it's visible, so a thread stealing it can't take the count below zero
+        std::lock_guard lock(sleep_mutex);
+        queued++;
+    }
+    {
+        std::lock_guard lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+    task_added.notify_one();
+    task_finished.notify_all(); // Waiting threads help out with queued work
+}
+
+// Pops the newest task of the home queue, or steals the oldest task of another
+bool thread_pool::run_one(size_t home) {
+    std::function<void()> task;
+    if (home != no_queue) {
+        queue& q = *queues[home];
+        std::lock_guard lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        }
+    }
+    size_t start = home != no_queue ? home + 1 : 0;
+    for (size_t i = 0; !task && i < queues.size(); i++) {
+        queue& victim = *queues[(start + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+    }
+    if (!task) return false;
+
+    queued--;
+    task();
+    finish_task();
+    return true;
+}
+
+// Taking the lock before notifying orders this against a waiter checking its condition, so no wakeup is lost
+void thread_pool::finish_task() {
+    { std::lock_guard lock(sleep_mutex); }
+    task_finished.notify_all();
+}
+
+void thread_pool::worker_loop(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    while (true) {
+        if (run_one(index)) continue;
+        std::unique_lock lock(sleep_mutex);
+        task_added.wait(lock, [this] { return stopping || queued != 0; });
+        if (stopping && queued == 0) return;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "basic_types.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task queue each. Workers take their own newest task first, and steal
+// the oldest task from another queue when theirs runs dry, so recursively split work stays spread across threads.
+// The thread that waits on the pool also runs tasks, so a pool with zero workers runs everything inline.
+class thread_pool : no_copy, no_move {
+public:
+	explicit thread_pool(size_t num_workers);
+	~thread_pool();
+
+	void submit(std::function<void()> task);
+	// Runs queued tasks on the calling thread until done() returns true
+	template <typename F>
+	void wait_until(F&& done) {
+		while (!done()) {
+			if (run_one(home_queue())) continue;
+			std::unique_lock lock(sleep_mutex);
+			task_finished.wait(lock, [&] { return done() || queued != 0; });
+		}
+	}
+	size_t num_threads() { return workers.size() + 1; }
+	static size_t default_workers() { return std::max(1u, std::thread::hardware_concurrency()) - 1; }
+
+	// Replays need identical results on every run, so in deterministic mode submit() runs each task immediately,
+	// on the submitting thread. Work then happens serially, in submission order.
+	bool deterministic = false;
+private:
+	struct queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+	static constexpr size_t no_queue = ~size_t(0);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<queue>> queues; // One per worker, and a last one for threads outside the pool
+	std::atomic<size_t> queued = 0;
+	std::atomic<size_t> next_queue = 0; // Round robin for tasks submitted from outside the pool
+	std::mutex sleep_mutex;
+	std::condition_variable task_added;
+	std::condition_variable task_finished;
+	bool stopping = false;
+
+	size_t home_queue();
+	bool run_one(size_t home);
+	void finish_task();
+	void worker_loop(size_t index);
+};
+
+// Splits [0, count) into ranges, calls func(first, last) for each one from the thread pool, and returns once all have run.
+// There are a few ranges per thread, so threads that finish early have something left to steal.
+template <typename F>
+void parallel_for_ranges(thread_pool& workers, size_t count, F&& func) {
+	size_t per_range = std::max<size_t>(1, count / (workers.num_threads() * 4));
+	if (workers.num_threads() == 1 || per_range >= count) {
+		if (count != 0) func(size_t(0), count);
+		return;
+	}
+
+	std::atomic<size_t> remaining = (count + per_range - 1) / per_range;
+	for (size_t first = 0; first < count; first += per_range) {
+		size_t last = std::min(count, first + per_range);
+		workers.submit([&func, &remaining, first, last]() {
+			func(first, last);
+			remaining--;
+		});
+	}
+	workers.wait_until([&remaining]() { return remaining == 0; });
+}
+
+#endif //THREAD_POOL_H
@@ -3,7 +3,9 @@
 
 #include <common/basic_types.h>
 #include <common/graphical_types.h>
+#include <common/thread_pool.h>
 #include "input_event.h"
+#include "render_list.h"
 #include <functional>
 #include <unordered_map>
 #include <string>
@@ -24,6 +26,7 @@ public:
 protected:
     virtual u32 get_new_id() = 0;
 private:
+    void pack_atlas(std::vector<texture*>& loaded);
     std::array<texture, 2048> textures;
     std::unordered_map<std::string, u32> texture_map;
 };
@@ -37,19 +40,27 @@ public:
     virtual void set_viewport(screen_coords) = 0;
     virtual void set_camera(vec2d<f32>) = 0;
     virtual void clear_screen() = 0;
+    // Called once everything for the frame has gone through render_layer, before the window shows it
+    virtual void end_frame() {}
+    // Renderers that split frames across threads run them on this pool instead of starting their own
+    virtual void share_workers(thread_pool&) {}
 
-    void clear_sprites();
-    void mark_sprites_dirty();
-    void add_sprite(sprite_data&);
+    render_list& sprites() { return _sprites; }
     void render_layer(texture_manager&);
+    size_t draw_calls() { return _draw_calls; } // Batches drawn during the last render_layer
+    rect<f32> visible_area() { return visible_world; }
 protected:
     virtual void render_batch(texture*, render_layers, texture_manager&) = 0;
+    // Draws a static_geometry sprite from the renderer's own copy of its quads. Returns false to have it batched normally.
+    virtual bool render_static(u32, texture*, render_layers, texture_manager&) { return false; }
 
-    std::vector<sprite_data> batching_pool;
-    vertex* vertex_buffer = nullptr;
-    u8* zindex_buffer = nullptr;
+    render_list _sprites;
+    quad_instance* instance_buffer = nullptr;
     size_t quads_batched = 0;
-    bool sprites_dirty = false;
+    rect<f32> visible_world; // World area under the camera, kept up to date by set_camera and set_viewport
+private:
+    void flush_batch(texture*, render_layers, texture_manager&);
+    size_t _draw_calls = 0;
 };
 
 struct window_impl {
@@ -1,19 +1,22 @@
 #include "display.h"
+#include <cstddef>
 #include <cstring>
 #include <fstream>
 #include <cmath>
 #include <assert.h>
 #include <common/parser.h>
 #include <common/png.h>
+#include <common/skyline_packer.h>
+#include "scaled_texture_cache.h"
+#include "tiled_rasterizer.h"
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 
 namespace display {
 
 // Some renderer constants
-constexpr unsigned quads_in_buffer = 1024;
-constexpr unsigned vertex_buffer_size = quads_in_buffer * vertices_per_quad * sizeof(vertex);
-constexpr unsigned zindex_buffer_size = quads_in_buffer * vertices_per_quad * sizeof(u8);
+constexpr size_t quads_in_buffer = 8192; // Most quads in a single batch
+constexpr size_t scaled_texture_budget = 32 * 1024 * 1024; // Bytes of scaled texture copies the software renderer keeps
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //     WINDOW, RENDERER AND TEXTURE MANAGER CLASS DECLARATIONS, FOR BOTH OPENGL AND SOFTWARE RENDERERS     //
@@ -47,6 +50,7 @@ private:
 class renderer_gl : public renderer {
 public:
     renderer_gl();
+    ~renderer_gl();
     void clear_screen();
     void set_viewport(screen_coords);
     void set_camera(vec2d<f32>);
@@ -55,16 +59,42 @@ public:
     static void initialize_opengl();
 private:
     void render_batch(texture*, render_layers, texture_manager&);
+    bool render_static(u32 handle, texture*, render_layers, texture_manager&);
     void update_texture_data(texture*);
 
-    class vbo {
+    // Ring of quad instances, split into segments. Each segment gets a fence after its last draw, and is only written again
+    // once the GPU has passed that fence, so batches append to the ring without orphaning or re-mapping the buffer.
+    // With ARB_buffer_storage the whole ring stays mapped for the renderer's lifetime. Without it, batches are written to
+    // a staging copy and uploaded with glBufferSubData right before their draw.
+    class stream_buffer {
     public:
-        vbo();
-        ~vbo();
+        stream_buffer(size_t bytes, bool persistent);
+        ~stream_buffer();
         void bind();
+        u8* data() { return _data; }
+        void flush(size_t offset, size_t bytes);
     private:
         u32 _id;
+        bool _persistent;
+        u8* _data = nullptr;
+        std::vector<u8> _staging;
     };
+    static constexpr size_t ring_segments = 3;
+    static constexpr size_t quads_per_segment = 4 * quads_in_buffer;
+
+    // Vertex attribute locations shared by every shader. Corners are per vertex, everything else is per quad instance.
+    enum vertex_attributes : u32 {
+        corner,
+        center,
+        quad_size,
+        rotation,
+        uv_rect,
+        z_index
+    };
+    void point_instance_attributes(size_t first_quad);
+
+    void next_segment();
+    void point_batch_buffers();
 
     class shader {
     public:
@@ -83,11 +113,24 @@ private:
 
     static shader gen_shader(std::string, std::string);
     renderer_gl::shader& get_shader(render_layers layer);
+    // Distance field textures are drawn with their own shader, whichever screen space layer they're on
+    renderer_gl::shader& get_shader(render_layers layer, texture* tex) { return tex->distance_field ? distance_field_shader : get_shader(layer); }
     renderer_gl::shader text_shader = gen_shader("shaders/ui.vert", "shaders/shader.frag");
+    renderer_gl::shader distance_field_shader = gen_shader("shaders/ui.vert", "shaders/distance_field.frag");
     renderer_gl::shader ui_shader = gen_shader("shaders/ui.vert", "shaders/shader.frag");
     renderer_gl::shader map_shader = gen_shader("shaders/world.vert", "shaders/shader.frag");
-    renderer_gl::vbo vertex_vbo;
-    renderer_gl::vbo zindex_vbo;
+    bool persistent_mapping = GLEW_ARB_buffer_storage;
+    renderer_gl::stream_buffer instance_stream {ring_segments * quads_per_segment * sizeof(quad_instance), persistent_mapping};
+    std::array<GLsync, ring_segments> segment_fences {};
+    size_t segment = 0;
+    size_t segment_quads = 0; // Quads already drawn from the current segment
+
+    // Quads of static_geometry sprites, uploaded once per version of their render list handle
+    struct static_buffer {
+        u32 id = 0;
+        u32 version = 0;
+    };
+    std::unordered_map<u32, static_buffer> static_buffers;
 
     size<f32> viewport;
     std::vector<f32> camera = { 1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1 };
@@ -122,21 +165,27 @@ private:
 class renderer_software : public renderer {
 public:
     renderer_software();
+    ~renderer_software();
     void clear_screen();
+    void end_frame();
     texture* add_texture(std::string name);
     void set_viewport(screen_coords);
     void set_camera(vec2d<f32>);
     framebuffer& get_framebuffer() { return fb;}
+    void share_workers(thread_pool& pool) { raster.share_workers(pool); }
 private:
     void render_batch(texture*, render_layers, texture_manager&);
     framebuffer fb;
     vec2d<f32> camera;
+    texture_filter filter = texture_filter::nearest; // Pixel art stays crisp when scaled up
+    tiled_rasterizer raster {0}; // Draws on the calling thread until the engine shares its pool
+    u64 frame_number = 0;
 };
 class texture_manager_software : public texture_manager {
 public:
     void update(texture*);
-    std::array<image, 2048> textures_2x_scaled;
-    std::array<image, 2048> textures_4x_scaled;
+    std::array<raster_texture, 2048> converted; // Every texture, in the rasterizer's layout
+    scaled_texture_cache scaled {scaled_texture_budget};
 private:
     u32 get_new_id();
     size_t texture_counter = 0;
@@ -153,6 +202,7 @@ private:
 void display_manager::render() {
     get_renderer().clear_screen();
     get_renderer().render_layer(textures());
+    get_renderer().end_frame();
     get_window().swap_buffers(get_renderer());
 }
 
@@ -175,6 +225,7 @@ void display_manager::initialize(display_types mode, screen_coords resolution) {
 #endif //OPENGL
     textures().load_textures();
     get_window().set_vsync(false);
+    get_renderer().set_viewport(get_window().resolution());
 }
 
 //////////////////////////////////////////////////////////////
@@ -242,51 +293,52 @@ std::vector<std::unique_ptr<input_event>> sdl_window::poll_events() {
 //     COMMON RENDERER CODE     //
 //////////////////////////////////
 
-void renderer::add_sprite(sprite_data& sprite) { batching_pool.emplace_back(sprite); }
-void renderer::clear_sprites() { batching_pool.clear(); }
-void renderer::mark_sprites_dirty() { sprites_dirty = true;}
+void renderer::flush_batch(texture* tex, render_layers layer, texture_manager& tm) {
+    if (quads_batched > 0) _draw_calls++;
+    render_batch(tex, layer, tm);
+}
 
 void renderer::render_layer(texture_manager& tm) {
-    if (batching_pool.size() == 0 ) return;
-
-    if (sprites_dirty) {
-        std::sort(batching_pool.begin(), batching_pool.end());
-        sprites_dirty = false;
-    }
-    texture* current_tex = (*batching_pool.begin()).tex;
-    render_layers layer = (*batching_pool.begin()).layer;
-
-    for(auto& sprite : batching_pool) {
-        if (sprite.tex != current_tex || sprite.layer != layer) {
-            render_batch(current_tex, layer, tm);
-            current_tex = sprite.tex;
+    _draw_calls = 0;
+    const std::vector<u32>& order = _sprites.draw_order();
+    if (order.size() == 0) return;
+
+    // Sprites are batched by the texture actually bound, so everything packed into one atlas page shares a batch
+    texture* current_tex = _sprites.get(order[0]).tex->bound_texture();
+    render_layers layer = _sprites.get(order[0]).layer;
+
+    for (u32 handle : order) {
+        sprite_data& sprite = _sprites.get(handle);
+        texture* sprite_tex = sprite.tex->bound_texture();
+        if (sprite_tex != current_tex || sprite.layer != layer) {
+            flush_batch(current_tex, layer, tm);
+            current_tex = sprite_tex;
             layer = sprite.layer;
         }
+        // Static sprites are usually large, like map chunks, so they're worth culling one by one
+        if (sprite.static_geometry && sprite.layer == render_layers::sprites) {
+            if (!AABB_collision(_sprites.bounds(handle), visible_world)) continue;
+            flush_batch(current_tex, layer, tm);
+            if (render_static(handle, current_tex, layer, tm)) {
+                _draw_calls++;
+                continue;
+            }
+        }
 
-        int quads_remaining = sprite.vertices().size() / vertices_per_quad;
-        while (quads_remaining > 0) {
-            const vertex* src_ptr = sprite.vertices().data() +  ((sprite.vertices().size() / vertices_per_quad) - quads_remaining)  * vertices_per_quad;
-            vertex* vertex_buffer_ptr = vertex_buffer + quads_batched * vertices_per_quad;
-            u8* zindex_buffer_ptr = zindex_buffer + quads_batched * vertices_per_quad;
-
-            int quads_to_batch = std::min(quads_in_buffer - quads_batched, size_t(quads_remaining));
-            int vertex_bytes_to_batch = quads_to_batch * vertices_per_quad * sizeof(vertex);
-            int zindex_bytes_to_batch = quads_to_batch * vertices_per_quad ;
-
-            quads_remaining -= quads_to_batch;
+        const std::vector<quad_instance>& instances = _sprites.instances(handle);
+        size_t quads_copied = 0;
+        while (quads_copied < instances.size()) {
+            size_t quads_to_batch = std::min(quads_in_buffer - quads_batched, instances.size() - quads_copied);
+            memcpy(instance_buffer + quads_batched, instances.data() + quads_copied, quads_to_batch * sizeof(quad_instance));
+            quads_copied += quads_to_batch;
             quads_batched += quads_to_batch;
 
-            memcpy(vertex_buffer_ptr, src_ptr, vertex_bytes_to_batch);
-            memset(zindex_buffer_ptr, sprite.z_index, zindex_bytes_to_batch);
-
             if (quads_batched == quads_in_buffer) {
-                current_tex = sprite.tex;
-                layer = sprite.layer;
-                render_batch(current_tex,layer, tm);
+                flush_batch(current_tex, layer, tm);
             }
         }
     }
-    render_batch(current_tex, layer, tm);
+    flush_batch(current_tex, layer, tm);
 }
 
 /////////////////////////////////////////
@@ -318,13 +370,59 @@ void load_pixel_data(texture* data, std::string filename) {
 void texture_manager::load_textures() {
     config_parser p("config/textures.txt");
     auto d = p.parse();
+    std::vector<texture*> loaded;
     for (auto it = d->begin(); it != d->end(); it++) {
         const config_list* list = dynamic_cast<const config_list*>((&it->second)->get());
         texture* tex = add(it->first);
         load_pixel_data(tex, "textures/" + list->get<std::string>(0));
         tex->regions = size<u16>(list->get<int>(1), list->get<int>(2));
-        update(tex);
+        loaded.push_back(tex);
+    }
+    pack_atlas(loaded);
+}
+
+// Pack every loaded texture into as few atlas pages as possible, so sprites using different textures can share a batch.
+// Each texture gets a one texel border copied from its edges, so sampling never bleeds in from its neighbours.
+// Textures too big for a page are kept as they are.
+void texture_manager::pack_atlas(std::vector<texture*>& loaded) {
+    constexpr u16 page_size = 256;
+    constexpr u16 border = 1;
+    std::sort(loaded.begin(), loaded.end(), [](texture* a, texture* b) { return a->image_data.size().y > b->image_data.size().y; });
+
+    std::vector<std::pair<texture*, skyline_packer>> pages;
+    for (texture* tex : loaded) {
+        size<u16> tex_size = tex->image_data.size();
+        size<u16> padded_size(tex_size.x + border * 2, tex_size.y + border * 2);
+        if (padded_size.x > page_size || padded_size.y > page_size) {
+            update(tex);
+            continue;
+        }
+
+        point<u16> position;
+        auto page = pages.begin();
+        while (page != pages.end() && !page->second.insert(padded_size, position)) page++;
+        if (page == pages.end()) {
+            texture* page_tex = add("atlas_page_" + std::to_string(pages.size()));
+            page_tex->image_data = image(std::vector<u8>(page_size * page_size * 4, 0), size<u16>(page_size, page_size));
+            page_tex->regions = size<u16>(1, 1);
+            pages.emplace_back(page_tex, skyline_packer(size<u16>(page_size, page_size)));
+            page = pages.end() - 1;
+            page->second.insert(padded_size, position);
+        }
+
+        image& dest = page->first->image_data;
+        for (i32 y = 0; y < padded_size.y; y++) {
+            for (i32 x = 0; x < padded_size.x; x++) {
+                i32 src_x = std::clamp<i32>(x - border, 0, tex_size.x - 1);
+                i32 src_y = std::clamp<i32>(y - border, 0, tex_size.y - 1);
+                dest.write((position.y + y) * page_size + position.x + x, tex->image_data.get(src_y * tex_size.x + src_x));
+            }
+        }
+        tex->page = page->first;
+        tex->page_uv = rect<f32>(point<f32>(position.x + border, position.y + border) / f32(page_size), tex_size.to<f32>() / f32(page_size));
+        tex->image_data = image();
     }
+    for (auto& page : pages) update(page.first);
 }
 
 #ifdef OPENGL
@@ -346,23 +444,49 @@ void gl_backend::set_vsync(bool state) { SDL_GL_SetSwapInterval(state ? 1 : 0);
 //*     OpenGL Renderer code    *//
 ///////////////////////////////////
 
-renderer_gl::vbo::vbo() {
+renderer_gl::stream_buffer::stream_buffer(size_t bytes, bool persistent) : _persistent(persistent) {
     glGenBuffers(1, &_id);
     bind();
+    if (_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+        _data = static_cast<u8*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        _staging.resize(bytes);
+        _data = _staging.data();
+    }
 }
 
-renderer_gl::vbo::~vbo() {
+renderer_gl::stream_buffer::~stream_buffer() {
+    if (_persistent) {
+        bind();
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
     glDeleteBuffers(1, &_id);
 }
 
-void renderer_gl::vbo::bind() {
+void renderer_gl::stream_buffer::bind() {
     glBindBuffer(GL_ARRAY_BUFFER, _id);
 }
 
+// Coherent mappings are visible to the GPU as they're written, so only the staging copy needs uploading
+void renderer_gl::stream_buffer::flush(size_t offset, size_t bytes) {
+    if (_persistent) return;
+    bind();
+    glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, _data + offset);
+}
+
 renderer_gl::shader::shader(u32 vert, u32 frag) {
     _ID = glCreateProgram();
     glAttachShader(_ID, vert);
     glAttachShader(_ID, frag);
+    glBindAttribLocation(_ID, vertex_attributes::corner, "corner");
+    glBindAttribLocation(_ID, vertex_attributes::center, "center");
+    glBindAttribLocation(_ID, vertex_attributes::quad_size, "quad_size");
+    glBindAttribLocation(_ID, vertex_attributes::rotation, "rotation");
+    glBindAttribLocation(_ID, vertex_attributes::uv_rect, "uv_rect");
+    glBindAttribLocation(_ID, vertex_attributes::z_index, "z_index");
     glLinkProgram(_ID);
     glDetachShader(_ID, vert);
     glDetachShader(_ID, frag);
@@ -435,36 +559,72 @@ renderer_gl::shader renderer_gl::gen_shader(std::string vert_filename, std::stri
 }
 
 
-template <typename T>
-T* map_buffer(size_t buffer_size) noexcept {
-    glBufferData(GL_ARRAY_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
-    return static_cast<T*>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
-}
-
-template <typename T>
-T* unmap_buffer() noexcept {
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    return nullptr;
-}
-
 void renderer_gl::render_batch(texture* current_tex, render_layers layer, texture_manager&) {
     if(quads_batched == 0) {
         return;
     }
     glBindTexture(GL_TEXTURE_2D, current_tex->id);
-    renderer_gl::shader& shader = get_shader(layer);
+    renderer_gl::shader& shader = get_shader(layer, current_tex);
     shader.bind();
-    zindex_vbo.bind();
-    zindex_buffer = unmap_buffer<u8>();
-    vertex_vbo.bind();
-    vertex_buffer = unmap_buffer<vertex>();
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(quads_batched * 6),
-                   GL_UNSIGNED_SHORT, (void*) 0);
-    vertex_vbo.bind();
-    vertex_buffer = map_buffer<vertex>(vertex_buffer_size);
-    zindex_vbo.bind();
-    zindex_buffer = map_buffer<u8>(zindex_buffer_size);
+
+    size_t first_quad = segment * quads_per_segment + segment_quads;
+    instance_stream.flush(first_quad * sizeof(quad_instance), quads_batched * sizeof(quad_instance));
+    // Every instance is the same two triangles over the four corners, placed by world.vert and ui.vert
+    instance_stream.bind();
+    point_instance_attributes(first_quad);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*) 0, static_cast<GLsizei>(quads_batched));
+
+    segment_quads += quads_batched;
     quads_batched = 0;
+    if (quads_per_segment - segment_quads < quads_in_buffer) next_segment();
+    point_batch_buffers();
+}
+
+bool renderer_gl::render_static(u32 handle, texture* current_tex, render_layers layer, texture_manager&) {
+    const std::vector<quad_instance>& instances = _sprites.instances(handle);
+    if (instances.empty()) return true;
+
+    static_buffer& buffer = static_buffers[handle];
+    if (buffer.id == 0) glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+    if (buffer.version != _sprites.version(handle)) {
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(quad_instance), instances.data(), GL_STATIC_DRAW);
+        buffer.version = _sprites.version(handle);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, current_tex->id);
+    get_shader(layer, current_tex).bind();
+    point_instance_attributes(0);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*) 0, static_cast<GLsizei>(instances.size()));
+    return true;
+}
+
+// Fence the segment just filled, and wait until the GPU is done with the oldest one before writing to it again
+void renderer_gl::next_segment() {
+    segment_fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    segment = (segment + 1) % ring_segments;
+    segment_quads = 0;
+
+    GLsync& fence = segment_fences[segment];
+    if (fence == nullptr) return;
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void renderer_gl::point_batch_buffers() {
+    instance_buffer = reinterpret_cast<quad_instance*>(instance_stream.data()) + segment * quads_per_segment + segment_quads;
+}
+
+// Batches start partway through the ring, so the per instance attributes are pointed at the batch's first record
+// in the currently bound buffer
+void renderer_gl::point_instance_attributes(size_t first_quad) {
+    size_t base = first_quad * sizeof(quad_instance);
+    glVertexAttribPointer(vertex_attributes::center, 2, GL_FLOAT, GL_FALSE, sizeof(quad_instance), (void*) (base + offsetof(quad_instance, center)));
+    glVertexAttribPointer(vertex_attributes::quad_size, 2, GL_FLOAT, GL_FALSE, sizeof(quad_instance), (void*) (base + offsetof(quad_instance, size)));
+    glVertexAttribPointer(vertex_attributes::rotation, 1, GL_FLOAT, GL_FALSE, sizeof(quad_instance), (void*) (base + offsetof(quad_instance, rotation)));
+    glVertexAttribPointer(vertex_attributes::uv_rect, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(quad_instance), (void*) (base + offsetof(quad_instance, uv_origin)));
+    glVertexAttribPointer(vertex_attributes::z_index, 1, GL_FLOAT, GL_FALSE, sizeof(quad_instance), (void*) (base + offsetof(quad_instance, z_index)));
 }
 
 renderer_gl::shader& renderer_gl::get_shader(render_layers layer) {
@@ -485,6 +645,7 @@ void GLAPIENTRY MessageCallback( GLenum source, GLenum type, GLuint id, GLenum s
 
 void renderer_gl::initialize_opengl() {
     glewInit();
+    if (!GLEW_VERSION_3_3 && !GLEW_ARB_instanced_arrays) throw std::runtime_error("Instanced rendering needs OpenGL 3.3 or ARB_instanced_arrays");
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_BLEND);
     glEnable(GL_DEPTH_TEST);
@@ -492,66 +653,60 @@ void renderer_gl::initialize_opengl() {
 }
 
 renderer_gl::renderer_gl() {
-    std::vector<u16> index_buffer = std::vector<u16>(quads_in_buffer * 6);
-
-    size_t vert_index = 0;
-    size_t array_index = 0;
-    while (array_index < index_buffer.size()) {
-        // top left corner
-        index_buffer[array_index] = vert_index;
-        index_buffer[array_index + 5] = vert_index ;
-        // top right
-        index_buffer[array_index + 1] = vert_index + 1;
-        // bottom left
-        index_buffer[array_index + 4] = vert_index + 3;
-        // bottom right
-        index_buffer[array_index + 2] = vert_index + 2;
-        index_buffer[array_index + 3] = vert_index + 2;
-
-        array_index += 6;
-        vert_index += 4;
-    }
+    // One quad, as corners in order top left, top right, bottom right, and bottom left
+    const f32 corners[] = { 0, 0,  1, 0,  1, 1,  0, 1 };
+    const u16 index_buffer[] = { 0, 1, 2, 2, 3, 0 };
+
+    GLuint cornerbuffer;
+    glGenBuffers(1, &cornerbuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cornerbuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(vertex_attributes::corner);
+    glVertexAttribPointer(vertex_attributes::corner, 2, GL_FLOAT, GL_FALSE, 0, (void*) 0);
 
     GLuint elementbuffer;
     glGenBuffers(1, &elementbuffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_buffer.size() * sizeof(u16), &index_buffer[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer), index_buffer, GL_STATIC_DRAW);
 
     get_shader(render_layers::text).register_uniform("color");
     get_shader(render_layers::text).register_uniform("viewport");
 
     get_shader(render_layers::ui).register_uniform("viewport");
+    distance_field_shader.register_uniform("viewport");
 
     get_shader(render_layers::sprites).register_uniform("viewport");
     get_shader(render_layers::sprites).register_uniform("viewMatrix");
 
+    for (u32 attribute : {vertex_attributes::center, vertex_attributes::quad_size, vertex_attributes::rotation, vertex_attributes::uv_rect, vertex_attributes::z_index}) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    instance_stream.bind();
+    point_instance_attributes(0);
+    point_batch_buffers();
+}
 
-    zindex_vbo.bind();
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, (void*) 0);
-
-    vertex_vbo.bind();
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*) 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*) (sizeof(sprite_coords)));
-
-
-    vertex_buffer = map_buffer<vertex>(vertex_buffer_size);
-    zindex_buffer = map_buffer<u8>(zindex_buffer_size);
+renderer_gl::~renderer_gl() {
+    for (GLsync fence : segment_fences) {
+        if (fence != nullptr) glDeleteSync(fence);
+    }
+    for (auto& [handle, buffer] : static_buffers) glDeleteBuffers(1, &buffer.id);
 }
 
 void renderer_gl::set_viewport(screen_coords screen_size) {
     glViewport(0, 0, screen_size.x, screen_size.y);
     viewport = size<f32>(128.0f / screen_size.x, 128.0f / screen_size.y);
+    visible_world.size = screen_size.to<f32>() / 64.0f;
     get_shader(render_layers::text).update_uniform("viewport", 2.0f / screen_size.x, 2.0f / screen_size.y);
     get_shader(render_layers::ui).update_uniform("viewport", 2.0f / screen_size.x, 2.0f / screen_size.y);
+    distance_field_shader.update_uniform("viewport", 2.0f / screen_size.x, 2.0f / screen_size.y);
     get_shader(render_layers::sprites).update_uniform("viewport", viewport.x, viewport.y);
     get_shader(render_layers::sprites).update_uniform("viewMatrix", camera.data());
 }
 
 void renderer_gl::set_camera(vec2d<f32> delta) {
+    visible_world.origin = delta;
     camera[12] = -((viewport.x) * delta.x);
     camera[13] = (viewport.y) * delta.y;
     get_shader(render_layers::sprites).update_uniform("viewMatrix", camera.data());
@@ -562,6 +717,16 @@ void renderer_gl::clear_screen()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearDepth(2);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Release the buffers of static sprites that have left the render list
+    for (auto it = static_buffers.begin(); it != static_buffers.end();) {
+        if (_sprites.live(it->first)) {
+            it++;
+            continue;
+        }
+        glDeleteBuffers(1, &it->second.id);
+        it = static_buffers.erase(it);
+    }
 }
 
 ///////////////////////////////////////////
@@ -569,13 +734,35 @@ void renderer_gl::clear_screen()
 ///////////////////////////////////////////
 
 void texture_manager_gl::update(texture* tex) {
+    if (!tex->dirty()) return;
     glBindTexture(GL_TEXTURE_2D, tex->id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->image_data.size().x, tex->image_data.size().y, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex->image_data.data().data());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    image& image_data = tex->image_data;
+    if (tex->dirty_whole) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_data.size().x, image_data.size().y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data.data().data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // Distances are filtered before they're turned into coverage, which is what keeps scaled distance fields sharp
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex->distance_field ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex->distance_field ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        // Regenerating mipmaps is a pass over the whole texture, which would undo the point of uploading a small area.
+        // Textures updated by area are generated ones, like text and healthbars, which are drawn at about their own size,
+        // so they stop sampling their now stale mip chain instead.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex->distance_field ? GL_LINEAR : GL_NEAREST);
+        // Areas are read straight out of the whole image, so rows are unpacked with its width
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, image_data.size().x);
+        for (rect<u16> area : tex->dirty_areas) {
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, area.origin.x);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, area.origin.y);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, area.origin.x, area.origin.y, area.size.x, area.size.y, GL_RGBA, GL_UNSIGNED_BYTE,
+                            image_data.data().data());
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+    tex->mark_clean();
 }
 
 u32 texture_manager_gl::get_new_id() {
@@ -631,35 +818,18 @@ software_backend::~software_backend() {
 //     SOFTWARE RENDERER CODE     //
 ////////////////////////////////////
 
-image rescale_texture(image source, size<u16> new_size) {
-    size<f32> upscale_ratio (new_size.x / source.size().x, new_size.y / source.size().y);
-    size<u16> upscaled_size(source.size().x * upscale_ratio.x, source.size().y * upscale_ratio.y);
-    image upscaled_tex(std::vector<u8>(upscaled_size.x * upscaled_size.y * 4), upscaled_size);
-
-    size_t write_index = 0;
-    size_t read_index = 0;
-    point<f32> read_pos(0, 0);
-    for (size_t y = 0; y < upscaled_size.y; y++) {
-        for (size_t x = 0; x < upscaled_size.x; x++) {
-            read_index = int(read_pos.x) + int(read_pos.y) * source.size().x ;
-            color c = source.get(read_index);
-            std::swap(c.r, c.b);
-            upscaled_tex.write(write_index, c);
-
-
-            write_index++;
-            read_pos.x += 1.0f / upscale_ratio.x;
-        }
-        read_pos.y += 1.0f / upscale_ratio.y;
-        read_pos.x = 0;
-    }
-    return upscaled_tex;
+void renderer_software::clear_screen() {
+    frame_number++;
+    raster.begin_frame(fb, true);
+}
+void renderer_software::end_frame() { raster.finish_frame(); }
+renderer_software::renderer_software() { instance_buffer = new quad_instance[quads_in_buffer]; }
+renderer_software::~renderer_software() { delete[] instance_buffer; }
+void renderer_software::set_viewport(screen_coords screen_size) { visible_world.size = screen_size.to<f32>() / 64.0f; }
+void renderer_software::set_camera(vec2d<f32> camera_in) {
+    camera = camera_in;
+    visible_world.origin = camera_in;
 }
-
-void renderer_software::clear_screen() { memset(fb.data(), 0, fb.size().x * fb.size().y * 4); }
-renderer_software::renderer_software() { vertex_buffer = new vertex[quads_in_buffer * vertices_per_quad]; }
-void renderer_software::set_viewport(screen_coords screen_size) { }
-void renderer_software::set_camera(vec2d<f32> camera_in) { camera = camera_in; }
 
 vertex transpose_vertex(std::array<f32, 6> matrix, vertex vert) {
     point<f32> new_vertex;
@@ -668,28 +838,6 @@ vertex transpose_vertex(std::array<f32, 6> matrix, vertex vert) {
     return vertex {new_vertex, vert.uv};
 }
 
-void render_quad(void* fb_data, screen_coords fb_size, image& texture_data, vertex tl_vert, vertex br_vert) {
-    point<f32> tl_clipped(round(std::max(0.0f, tl_vert.pos.x)), round(std::max(0.0f, tl_vert.pos.y)));
-    point<f32> br_clipped(round(std::min(f32(fb_size.x), br_vert.pos.x)), round(std::min(f32(fb_size.y), br_vert.pos.y)));
-    point<f32> clipped_offset = tl_clipped - tl_vert.pos;
-
-    size<u16> tl_texel(tl_vert.uv.x * texture_data.size().x + abs(clipped_offset.x), tl_vert.uv.y * texture_data.size().y + abs(clipped_offset.y));
-    size<u16> clipped_size = (br_clipped - tl_clipped).to<u16>();
-
-    size_t fb_write_start = (tl_clipped.x  + (tl_clipped.y * fb_size.x)) * 4;
-    size_t fb_write_stride = (fb_size.x) * 4;
-    size_t tex_read_start = (tl_texel.x  + (tl_texel.y * texture_data.size().x)) * 4;
-    size_t tex_read_stride = (texture_data.size().x) * 4;
-    size_t bytes_per_line = clipped_size.x * 4;
-
-    for (size_t y = 0; y < clipped_size.y; y++) {
-        auto dest_offset = fb_write_start + (y * fb_write_stride);
-        auto src_offset = tex_read_start + (y * tex_read_stride);
-
-        memcpy(reinterpret_cast<char*>(fb_data) + dest_offset, texture_data.data().data() + src_offset, bytes_per_line);
-    }
-}
-
 void renderer_software::render_batch(texture* current_tex, render_layers layer, texture_manager& tm_base) {
     std::array<f32, 6> matrix;
     switch (layer) {
@@ -708,25 +856,50 @@ void renderer_software::render_batch(texture* current_tex, render_layers layer,
 
     auto& textures = dynamic_cast<texture_manager_software&>(tm_base);
     rect<f32> frame(point<f32>(0, 0), fb.size().to<f32>());
-    for (size_t i = 0; i < quads_batched * 4; i+= 4) {
-        const auto tl_vert = transpose_vertex(matrix, vertex_buffer[i]);
-        const auto br_vert = transpose_vertex(matrix, vertex_buffer[i + 2]);
+    for (size_t i = 0; i < quads_batched; i++) {
+        const quad_instance& quad = instance_buffer[i];
+        texture_filter quad_filter = current_tex->distance_field ? texture_filter::distance_field : filter;
+        if (!quad.axis_aligned()) {
+            // Rotated and mirrored quads are mapped back into the texture pixel by pixel, from their first corner and edges
+            f32 s = sin(quad.rotation);
+            f32 c = cos(quad.rotation);
+            sprite_coords across(quad.size.x * c, quad.size.x * s);
+            sprite_coords down(-quad.size.y * s, quad.size.y * c);
+            auto transform_edge = [&](sprite_coords edge) { return point<f32>(matrix[0] * edge.x + matrix[1] * edge.y, matrix[3] * edge.x + matrix[4] * edge.y); };
+            point<f32> origin = transpose_vertex(matrix, vertex {quad.center - (across + down) * 0.5f, quad.uv_tl()}).pos;
+
+            size<f32> tex_size = current_tex->image_data.size().to<f32>();
+            point<i32> uv_tl(std::lround(quad.uv_tl().x * tex_size.x), std::lround(quad.uv_tl().y * tex_size.y));
+            point<i32> uv_br(std::lround(quad.uv_br().x * tex_size.x), std::lround(quad.uv_br().y * tex_size.y));
+            raster.add_transformed(textures.converted[current_tex->id], rect<i32>(uv_tl, uv_br - uv_tl), origin, transform_edge(across), transform_edge(down), quad_filter);
+            continue;
+        }
+
+        // Everything else is blitted as a rectangle, so only its corners are needed
+        sprite_coords half_size = quad.size * 0.5f;
+        const auto tl_vert = transpose_vertex(matrix, vertex {quad.center - half_size, quad.uv_tl()});
+        const auto br_vert = transpose_vertex(matrix, vertex {quad.center + half_size, quad.uv_br()});
 
         rect<f32> sprite_rect(tl_vert.pos, br_vert.pos - tl_vert.pos);
         if (!AABB_collision(frame, sprite_rect)) continue;
 
-        size<f32> subregion_size = current_tex->image_data.size().to<f32>() * (br_vert.uv - tl_vert.uv);
-
-        // test if the sprite's render size is 4x the texture, 2x, 1x, or something else.
-        if ((subregion_size * 4) - sprite_rect.size < size<f32>(0.01, 0.01)) {
-            render_quad(fb.data(), fb.size(), textures.textures_4x_scaled[current_tex->id], tl_vert, br_vert);
-        } else if ((subregion_size * 2) - sprite_rect.size < size<f32>(0.01, 0.01)) {
-            render_quad(fb.data(), fb.size(), textures.textures_2x_scaled[current_tex->id], tl_vert, br_vert);
-        } else if (subregion_size - sprite_rect.size < size<f32>(0.01, 0.01)) {
-            render_quad(fb.data(), fb.size(), current_tex->image_data, tl_vert, br_vert);
+        // Quads showing their texture region at its own size are copied straight from the texture. Any other size is
+        // drawn from a cached copy scaled to fit, or sampled on the fly if the size hasn't been seen before.
+        raster_texture& source = textures.converted[current_tex->id];
+        point<f32> texel_tl = tl_vert.uv * current_tex->image_data.size().to<f32>();
+        point<f32> texel_br = br_vert.uv * current_tex->image_data.size().to<f32>();
+        rect<i32> region(point<i32>(std::lround(texel_tl.x), std::lround(texel_tl.y)),
+                         size<i32>(std::lround(texel_br.x - texel_tl.x), std::lround(texel_br.y - texel_tl.y)));
+        size<i32> target(std::lround(br_vert.pos.x) - std::lround(tl_vert.pos.x), std::lround(br_vert.pos.y) - std::lround(tl_vert.pos.y));
+        if (target.x <= 0 || target.y <= 0 || region.size.x <= 0 || region.size.y <= 0) continue;
+
+        // Distance fields are never copied as they are, since their texels have to be turned into coverage first
+        if (target == region.size && !current_tex->distance_field) {
+            raster.add(source, region.origin, tl_vert.pos, br_vert.pos);
+        } else if (raster_texture* copy = textures.scaled.get(current_tex->id, source, region, target.to<u16>(), quad_filter, frame_number)) {
+            raster.add(*copy, point<i32>(0, 0), tl_vert.pos, br_vert.pos);
         } else {
-            image a = rescale_texture(current_tex->image_data, sprite_rect.size.to<u16>());
-            render_quad(fb.data(), fb.size(), a, tl_vert, br_vert);
+            raster.add_scaled(source, region, tl_vert.pos, br_vert.pos, quad_filter);
         }
     }
     quads_batched = 0;
@@ -738,10 +911,19 @@ void renderer_software::render_batch(texture* current_tex, render_layers layer,
 
 void texture_manager_software::update(texture* tex) {
     image& image_data = tex->image_data;
-    if(image_data.size().x == 0 && image_data.size().y == 0) return;
+    if (!tex->dirty() || (image_data.size().x == 0 && image_data.size().y == 0)) return;
 
-    textures_2x_scaled[tex->id] = rescale_texture(image_data, size<u16>(image_data.size().x * 2, image_data.size().y * 2));
-    textures_4x_scaled[tex->id] = rescale_texture(image_data, size<u16>(image_data.size().x * 4, image_data.size().y * 4));
+    if (tex->dirty_whole) {
+        converted[tex->id] = tex->distance_field ? raster_texture::distance_field(image_data) : raster_texture(image_data);
+        scaled.invalidate(tex->id);
+    } else {
+        for (rect<u16> area : tex->dirty_areas) {
+            rect<i32> changed(area.origin.to<i32>(), area.size.to<i32>());
+            converted[tex->id].update(image_data, changed);
+            scaled.invalidate(tex->id, changed);
+        }
+    }
+    tex->mark_clean();
 }
 
 u32 texture_manager_software::get_new_id() {
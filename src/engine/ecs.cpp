@@ -8,12 +8,19 @@
 #include <atomic>
 #include <common/png.h>
 #include <cmath>
+#include <limits>
+#ifdef SSE
+#include <xmmintrin.h>
+#endif
 #include <ft2build.h>
 #include <harfbuzz/hb.h>
 #include <harfbuzz/hb-ft.h>
 #include "ecs.h"
+#include "glyph_cache.h"
+#include "shaping_cache.h"
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
+#include FT_MODULE_H
 
 namespace ecs {
 
@@ -21,59 +28,164 @@ namespace ecs {
 //     ECS ENGINE CODE     //
 /////////////////////////////
 
-std::vector<entity> entity_manager::remove_marked() {
-	std::vector<entity> destroyed_list;
-    for(auto& bucket: buckets) {
-    	const std::unique_lock lock(bucket.mutex);
-        for(auto id: bucket.ids) {
-        	entity_freelist.push_back(id);
-        	destroyed_list.push_back(id);
+entity_manager::entity_manager() {
+    static std::atomic<u64> next_serial = 0;
+    serial = next_serial++;
+    entity_freelist.reserve(max_entities);
+    generations.reserve(max_entities);
+    destroyed.reserve(max_entities);
+}
+
+entity_manager::~entity_manager() {
+    for (mark_buffer* buffer = mark_buffers; buffer != nullptr;) {
+        mark_buffer* next = buffer->next;
+        delete buffer;
+        buffer = next;
+    }
+}
+
+const std::vector<entity>& entity_manager::remove_marked() {
+    destroyed.clear();
+    for (mark_buffer* buffer = mark_buffers; buffer != nullptr; buffer = buffer->next) {
+        for (auto id : buffer->ids) {
+            generations[entity_index(id)]++;
+            entity_freelist.push_back(entity_index(id));
+            destroyed.push_back(id);
+            marked_indices[entity_index(id) / 64].store(0, std::memory_order_relaxed);
         }
-        bucket.ids.clear();
+        buffer->ids.clear();
     }
-    return destroyed_list;
+    return destroyed;
 }
 
 void entity_manager::mark_entity(entity id) {
-    const auto bucket_id = get_thread_id() % bucket_count;
-    auto& bucket = buckets[bucket_id];
-    const std::unique_lock lock(bucket.mutex);
-    bucket.ids.push_back(id);
+    if (!alive(id)) return;
+    u64 bit = 1ull << (entity_index(id) % 64);
+    // Only the first mark of an entity makes it into a buffer
+    if (marked_indices[entity_index(id) / 64].fetch_or(bit, std::memory_order_relaxed) & bit) return;
+    thread_buffer().ids.push_back(id);
 }
 
-std::size_t entity_manager::get_thread_id() noexcept {
-	static std::atomic<std::size_t> generator = 0;
-    const thread_local auto id = generator.fetch_add(1, std::memory_order_relaxed);
-    return id;
+// Finds this thread's buffer, creating and publishing one on its first mark. Each entity is marked at most once between
+// calls to remove_marked, so a buffer with room for every index never grows, however many one thread marks in a tick.
+entity_manager::mark_buffer& entity_manager::thread_buffer() {
+    thread_local u64 cached_serial = ~0ull;
+    thread_local mark_buffer* cached_buffer = nullptr;
+    if (cached_serial == serial) return *cached_buffer;
+
+    mark_buffer* buffer = mark_buffers.load(std::memory_order_acquire);
+    for (; buffer != nullptr; buffer = buffer->next) {
+        if (buffer->owner == std::this_thread::get_id()) break;
+    }
+    if (buffer == nullptr) {
+        buffer = new mark_buffer {std::vector<entity>(), std::this_thread::get_id(), mark_buffers.load(std::memory_order_relaxed)};
+        buffer->ids.reserve(max_entities);
+        while (!mark_buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed));
+    }
+    cached_serial = serial;
+    cached_buffer = buffer;
+    return *buffer;
 }
 
-entity_manager::entity_manager() {
-	entity_freelist = std::vector<u32>(max_entities);
-	std::iota (std::begin(entity_freelist), std::end(entity_freelist), 0); // Fill with 0, 1, ..., 99.
+// Each system declares what it reads and writes, which decides what may run alongside it.
+// s_shooting creates bullets, which writes every pool egen_bullet adds to.
+// s_health marks dead entities for destruction, so it writes the entity store as well.
+// proxinteract only reads, and is added ahead of s_health so the two can overlap.
+void ecs_engine::schedule_systems() {
+    using ids = resource_ids;
+    scheduler.add("velocity", resources<velocity>(), resources<transform>(), [this]() {
+        system_velocity_run(workers, pool<velocity>(), pool<transform>(), _framerate_multiplier);
+    });
+    scheduler.add("collision", resources<display, transform, mapdata>(), resources<collision>({ids::contacts}), [this]() {
+        systems.collision.run(workers, view<collision, display>(), pool<collision>(), pool<transform>(), *pool<mapdata>().begin());
+    });
+    scheduler.add("shooting", resources<weapon_pool>({ids::texture_store}),
+                  resources<player, display, transform, damage, collision, velocity>({ids::entity_store}), [this]() {
+        systems.shooting.run(pool<display>(), pool<transform>(), pool<weapon_pool>(), pool<player>().get(_player_id));
+    });
+    scheduler.add("proxinteract", resources<proximity, widget, display, transform>(), resources<>(), [this]() {
+        systems.proxinteract.run(view<proximity, widget>(), world_bounds(_player_id));
+    });
+    scheduler.add("health", resources<damage>({ids::contacts}), resources<health>({ids::healthbar_atlas, ids::entity_store}), [this]() {
+        systems.health.run(pool<health>(), pool<damage>(), systems.collision.contacts, entities);
+    });
+    scheduler.add("healthbars", resources<>(), resources<health, display>({ids::healthbar_atlas}), [this]() {
+        systems.health.update_healthbars(view<health, display>());
+    });
+    scheduler.add("text", resources<>(), resources<text, display>({ids::text_atlas}), [this]() {
+        systems.text.run(view<text, display>());
+    });
 }
 
 void ecs_engine::run_ecs(int framerate_multiplier) {
-    player& player_component = pool<player>().get(_player_id);
-	system_velocity_run(pool<velocity>(), pool<display>(), framerate_multiplier);
-	system_collison_run(pool<collision>(), pool<display>(), *pool<mapdata>().begin());
-	systems.shooting.run(pool<display>(), pool<weapon_pool>(), player_component);
-	systems.health.run(pool<health>(), pool<damage>(), entities);
-	systems.health.update_healthbars(pool<health>(), pool<display>());
-    systems.proxinteract.run(pool<proximity>(), pool<widget>(), pool<display>().get(_player_id));
-	systems.text.run(pool<text>(), pool<display>());
-	std::vector<entity> destroyed = entities.remove_marked();
-	for (auto entity : destroyed) {
+    if (scheduler.empty()) schedule_systems();
+    _framerate_multiplier = framerate_multiplier;
+    scheduler.run(workers);
+	for (auto entity : entities.remove_marked()) {
 		components.remove_all(entity);
 	}
 }
 
-entity entity_manager::add_entity() {
-	if (entity_freelist.empty()) throw "error af";
-	entity e = entity_freelist[0];
+void system_scheduler::add(std::string name, resource_set reads, resource_set writes, std::function<void()> func) {
+    systems.push_back(node {reads, writes, std::move(func), {}, 0});
+    system_timings.push_back(timing {std::move(name)});
+    built = false;
+}
+
+void system_scheduler::build() {
+    for (auto& system : systems) {
+        system.dependents.clear();
+        system.num_dependencies = 0;
+    }
+    for (u32 later = 0; later < systems.size(); later++) {
+        node& b = systems[later];
+        for (u32 earlier = 0; earlier < later; earlier++) {
+            node& a = systems[earlier];
+            bool conflict = (a.writes & (b.reads | b.writes)).any() || (a.reads & b.writes).any();
+            if (!conflict) continue;
+            a.dependents.push_back(later);
+            b.num_dependencies++;
+        }
+    }
+    pending = std::make_unique<std::atomic<u32>[]>(systems.size());
+    built = true;
+}
 
-	std::swap(entity_freelist[0], entity_freelist.back());
+void system_scheduler::run(thread_pool& workers) {
+    timer tick;
+    if (!built) build();
+    remaining = systems.size();
+    for (u32 i = 0; i < systems.size(); i++) {
+        pending[i] = systems[i].num_dependencies;
+    }
+    for (u32 i = 0; i < systems.size(); i++) {
+        if (systems[i].num_dependencies == 0) workers.submit([this, &workers, i]() { run_system(i, workers); });
+    }
+    workers.wait_until([this]() { return remaining == 0; });
+    last_tick_ms = tick.elapsed<timer::microseconds>().count() / 1000.0f;
+}
+
+void system_scheduler::run_system(u32 index, thread_pool& workers) {
+    timer t;
+    systems[index].func();
+    system_timings[index].ms = t.elapsed<timer::microseconds>().count() / 1000.0f;
+    for (u32 dependent : systems[index].dependents) {
+        if (--pending[dependent] == 0) workers.submit([this, &workers, dependent]() { run_system(dependent, workers); });
+    }
+    // Only counted once its dependents are queued, so the run can't finish with work outstanding
+    remaining--;
+}
+
+entity entity_manager::add_entity() {
+	if (entity_freelist.empty()) {
+		// Hand out a fresh index
+		if (generations.size() >= max_entities) throw "error af";
+		generations.push_back(0);
+		return make_entity(generations.size() - 1, 0);
+	}
+	u32 index = entity_freelist.back();
 	entity_freelist.pop_back();
-	return e;
+	return make_entity(index, generations[index]);
 }
 
 ////////////////////////////////
@@ -103,6 +215,78 @@ u32 display::add_sprite(u16 num_quads, texture* tex, u16 z_index, render_layers
     return _sprites.size() - 1;
 }
 
+transform pool<transform>::reference::value() const {
+    transform t;
+    t.parent = _page->parents[_slot];
+    t.position = position();
+    t.rotation = rotation();
+    t.scale = scale();
+    return t;
+}
+
+pool<transform>::reference pool<transform>::add(entity e, const transform t) {
+    size_t index = entity_index(e);
+    size_t page_index = index / page_size;
+    if (page_index >= _pages.size()) _pages.resize(page_index + 1);
+    if (!_pages[page_index]) _pages[page_index] = std::make_unique<page>();
+
+    page& p = *_pages[page_index];
+    u64 bit = 1ull << (index % page_size);
+    if ((p.markers & bit) == 0) _count++;
+    p.markers |= bit;
+    p.parents[index % page_size] = e;
+
+    reference added(p, index % page_size);
+    added.set_position(t.position);
+    added.set_rotation(t.rotation);
+    added.set_scale(t.scale);
+    return added;
+}
+
+void pool<transform>::remove(entity e) {
+    if (!exists(e)) return;
+    size_t index = entity_index(e);
+    page& p = *_pages[index / page_size];
+    p.markers &= ~(1ull << (index % page_size));
+    _count--;
+}
+
+void pool<transform>::move_page(size_t word, const f32* dx, const f32* dy) {
+    page& p = *_pages[word];
+#ifdef SSE
+    for (size_t i = 0; i < page_size; i += 4) {
+        _mm_store_ps(&p.x[i], _mm_add_ps(_mm_load_ps(&p.x[i]), _mm_load_ps(dx + i)));
+        _mm_store_ps(&p.y[i], _mm_add_ps(_mm_load_ps(&p.y[i]), _mm_load_ps(dy + i)));
+    }
+#else
+    for (size_t i = 0; i < page_size; i++) {
+        p.x[i] += dx[i];
+        p.y[i] += dy[i];
+    }
+#endif
+}
+
+rect<f32> world_bounds(display& dpy, pool<transform>& transforms) {
+    rect<f32> bounds = dpy.get_dimensions();
+    if (!transforms.exists(dpy.parent)) return bounds;
+
+    transform t = transforms.get(dpy.parent).value();
+    f32 s = sin(t.rotation);
+    f32 c = cos(t.rotation);
+    world_coords min(std::numeric_limits<f32>::max(), std::numeric_limits<f32>::max());
+    world_coords max(std::numeric_limits<f32>::lowest(), std::numeric_limits<f32>::lowest());
+    for (world_coords corner : {bounds.origin, bounds.top_right(), bounds.bottom_right(), bounds.bottom_left()}) {
+        f32 x = corner.x * t.scale.x;
+        f32 y = corner.y * t.scale.y;
+        world_coords placed((x * c) - (y * s) + t.position.x, (x * s) + (y * c) + t.position.y);
+        min.x = std::min(min.x, placed.x);
+        min.y = std::min(min.y, placed.y);
+        max.x = std::max(max.x, placed.x);
+        max.y = std::max(max.y, placed.y);
+    }
+    return rect<f32>(min, max - min);
+}
+
 rect<f32> display::get_dimensions() {
     sprite_coords min(65535, 65535);
     sprite_coords max(0, 0);
@@ -127,69 +311,142 @@ rect<f32> display::get_dimensions() {
 //     S_COLLISION     //
 /////////////////////////
 
-bool sprite_has_collision(size_t i, collision& col) {
-    for (auto it : col.disabled_sprites)
-        if (it == i) return false;
-    return true;
+bool collision::sprite_has_collision(sprite_id i) {
+    return i >= disabled_sprites.size() || !disabled_sprites.test(i);
 }
 
-// add the normals of all valid sprites in dpy to the vector normals
-void add_normals(display& dpy, collision& col,std::vector<world_coords>& normals) {
-    size_t index = 0;
+// Gather the points and edge normals of every sprite with collision, and precompute their projections.
+// Sprite quads are always rectangles, so the first two edges of each quad give all of its separating axes.
+// The local hull is only rebuilt when a sprite or the set of disabled sprites changes. Placing it in the world by the
+// transform is redone every call.
+void collision::update_hull(display& dpy, const transform* t) {
+    u64 revision = 0;
+    size_t num_sprites = 0;
     for (auto& sprite : dpy) {
-        index++;
-        if (!sprite_has_collision(index - 1, col)) continue;
+        revision += sprite.revision();
+        num_sprites++;
+    }
+    bool changed = revision != local.revision || num_sprites != local.num_sprites || disabled_sprites != local.disabled_sprites;
+    if (changed) {
+        local.revision = revision;
+        local.num_sprites = num_sprites;
+        local.disabled_sprites = disabled_sprites;
+
+        local.points.clear();
+        local.axes.clear();
+        local.axis_aligned = true;
+        sprite_id index = 0;
+        for (auto& sprite : dpy) {
+            if (!sprite_has_collision(index++)) continue;
+            auto& vertices = sprite.vertices();
+            for (size_t quad = 0; quad + vertices_per_quad <= vertices.size(); quad += vertices_per_quad) {
+                for (size_t i = quad; i < quad + 2; i++) {
+                    world_coords edge = vertices[i + 1].pos - vertices[i].pos;
+                    if (edge.x == 0 && edge.y == 0) continue;
+                    if (edge.x != 0 && edge.y != 0) local.axis_aligned = false;
+                    local.axes.push_back(hull::axis{world_coords(-edge.y, edge.x), 0, 0});
+                }
+                for (size_t i = quad; i < quad + vertices_per_quad; i++) {
+                    local.points.push_back(vertices[i].pos);
+                }
+            }
+        }
+        local.compute_bounds();
+        local.compute_projections();
+    }
+
+    if (t == nullptr) {
+        if (changed) shape = local;
+        return;
+    }
 
-        // Get the edge vector between two consecutive vertices, then compute and add the normal
-        for (size_t i = 0; i < sprite.vertices().size(); i++) {
-            size_t vert_index = i + 1 == sprite.vertices().size() ? 0 : i + 1;
-            world_coords edge = sprite.vertices()[vert_index].pos - sprite.vertices()[i].pos;
-            normals.push_back(world_coords(-edge.y, edge.x));
+    shape.points.resize(local.points.size());
+    shape.axes.resize(local.axes.size());
+    if (t->rotation == 0 && t->scale == world_coords(1, 1)) {
+        // Translation leaves the normals alone, and shifts each projection by the normal's dot with the offset
+        for (size_t i = 0; i < local.points.size(); i++) shape.points[i] = local.points[i] + t->position;
+        for (size_t i = 0; i < local.axes.size(); i++) {
+            const hull::axis& axis = local.axes[i];
+            f32 offset = (t->position.x * axis.normal.x) + (t->position.y * axis.normal.y);
+            shape.axes[i] = hull::axis{axis.normal, axis.min + offset, axis.max + offset};
         }
+        shape.axis_aligned = local.axis_aligned;
+        shape.bounds = rect<f32>(local.bounds.origin + t->position, local.bounds.size);
+        return;
     }
+
+    f32 s = sin(t->rotation);
+    f32 c = cos(t->rotation);
+    for (size_t i = 0; i < local.points.size(); i++) {
+        f32 x = local.points[i].x * t->scale.x;
+        f32 y = local.points[i].y * t->scale.y;
+        shape.points[i] = world_coords((x * c) - (y * s) + t->position.x, (x * s) + (y * c) + t->position.y);
+    }
+    // Normals go through the inverse scale, so they stay perpendicular to their edges
+    shape.axis_aligned = true;
+    for (size_t i = 0; i < local.axes.size(); i++) {
+        f32 x = local.axes[i].normal.x / t->scale.x;
+        f32 y = local.axes[i].normal.y / t->scale.y;
+        world_coords normal((x * c) - (y * s), (x * s) + (y * c));
+        if (normal.x != 0 && normal.y != 0) shape.axis_aligned = false;
+        shape.axes[i].normal = normal;
+    }
+    shape.compute_bounds();
+    shape.compute_projections();
 }
 
-// Project the vertices of the shape onto each normal, to determine overlaps and gaps
-void project_shape(display& spr, collision& col, world_coords normal, f32& min, f32& max) {
-    size_t index = 0;
-    for (auto& sprite : spr) {
-        index++;
-        if (!sprite_has_collision(index - 1, col)) continue;
-        // Projection onto an axis is the dot product of each vertex with the axis normal.
-        for (auto vertex : sprite.vertices()) {
-            f32 projection = (vertex.pos.x * normal.x) + (vertex.pos.y * normal.y);
-            min = std::min(min, projection);
-            max = std::max(max, projection);
-        }
+void collision::hull::compute_bounds() {
+    if (points.empty()) return;
+    world_coords min = points[0], max = points[0];
+    for (auto point : points) {
+        min.x = std::min(min.x, point.x);
+        min.y = std::min(min.y, point.y);
+        max.x = std::max(max.x, point.x);
+        max.y = std::max(max.y, point.y);
     }
+    bounds = rect<f32>(min, max - min);
 }
 
-// SAT collision detection - if there's a gap between two shapes, they don't collide.
-// To find if there's a gap, first get the normals of each edge of each sprite.
-// Then, project each shape on the axis, and test the min/max of the projections for overlap.
-bool test_collision(display& a_dpy, collision& a_col, display& b_dpy, collision& b_col) {
-    std::vector<world_coords> normals;
-    add_normals(a_dpy, a_col, normals);
-    add_normals(b_dpy, b_col, normals);
-
-    for (auto normal : normals) {
-        f32 a_min = 65535, a_max = 0, b_min = 65535, b_max = 0;
-
-        // Project both sprites onto the axis
-        project_shape(a_dpy, a_col, normal, a_min, a_max);
-        project_shape(b_dpy, b_col, normal, b_min, b_max);
-        // Test for a gap between the min and maxes of both projections
-        bool a = (a_min < b_max) && (a_min > b_min);
-        bool b = (b_min < a_max) && (b_min > a_min);
-        if ((a || b) == false) {
-            return false;
+void collision::hull::compute_projections() {
+    for (auto& axis : axes) {
+        axis.min = std::numeric_limits<f32>::max();
+        axis.max = std::numeric_limits<f32>::lowest();
+        for (auto point : points) {
+            f32 projection = (point.x * axis.normal.x) + (point.y * axis.normal.y);
+            axis.min = std::min(axis.min, projection);
+            axis.max = std::max(axis.max, projection);
         }
     }
-    return true;
 }
 
+// Project b's points onto each of a's axes, and compare against a's cached projection.
+bool has_separating_axis(collision::hull& a, collision::hull& b) {
+    for (auto& axis : a.axes) {
+        f32 min = std::numeric_limits<f32>::max();
+        f32 max = std::numeric_limits<f32>::lowest();
+        for (auto point : b.points) {
+            f32 projection = (point.x * axis.normal.x) + (point.y * axis.normal.y);
+            min = std::min(min, projection);
+            max = std::max(max, projection);
+        }
+        if (max <= axis.min || min >= axis.max) return true;
+    }
+    return false;
+}
 
-
+// SAT collision detection - if there's a gap between two shapes, they don't collide.
+// Both hulls carry their edge normals and own projections, so each pair only projects the other shape's points.
+// Axis-aligned shapes only have the x and y axes, so the bounding box test is the whole SAT test for them.
+bool test_collision(collision::hull& a, collision::hull& b) {
+    if (a.points.empty() || b.points.empty()) return false;
+    rect<f32>& a_box = a.bounds;
+    rect<f32>& b_box = b.bounds;
+    bool overlap = a_box.origin.x < b_box.origin.x + b_box.size.x && b_box.origin.x < a_box.origin.x + a_box.size.x &&
+                   a_box.origin.y < b_box.origin.y + b_box.size.y && b_box.origin.y < a_box.origin.y + a_box.size.y;
+    if (!overlap) return false;
+    if (a.axis_aligned && b.axis_aligned) return true;
+    return !has_separating_axis(a, b) && !has_separating_axis(b, a);
+}
 
 mapdata::tile_data get_tiledata(mapdata& data, world_coords pos) {
     world_coords trunc_pos(trunc(pos.x), trunc(pos.y));
@@ -219,50 +476,80 @@ cant wait to be 6.9
     return false;
 }
 
-void system_collison_run(pool<collision>& collisions, pool<display>& sprites, mapdata& data) {
-    for (auto col_a : collisions) {
-        display& spr_a = sprites.get(col_a.parent);
-        //if (map_collision(spr_a, data, col_a.get_tilemap_collision())) { col_a.on_collide(data.parent); }
-        u8 a_sig = col_a.get_team_signals();
-        u8 a_dec = col_a.get_team_detectors();
-
-        auto col_it = pool<collision>::iterator(col_a.parent + 1, &collisions);
-        for (; col_it != collisions.end(); ++col_it) {
-            auto col_b = *col_it;
-            u8 b_sig = col_b.get_team_signals();
-            u8 b_dec = col_b.get_team_detectors();
-            if (((a_sig & b_dec) == 0) && ((b_sig & a_dec) == 0)) continue;
-
-            display& spr_b = sprites.get(col_b.parent);
-            if (test_collision(spr_a, col_a, spr_b, col_b)) {
-                col_b.on_collide(col_a.parent);
-                col_a.on_collide(col_b.parent);
+bool teams_interact(collision& a, collision& b) {
+    return ((a.get_team_signals() & b.get_team_detectors()) != 0) || ((b.get_team_signals() & a.get_team_detectors()) != 0);
+}
+
+void s_collision::run(thread_pool& workers, view<collision, display> shapes, pool<collision>& collisions, pool<transform>& transforms, mapdata& data) {
+    pairs_tested = 0;
+    contacts.clear();
+    // Hulls only depend on their own entity, so they can be rebuilt in parallel
+    parallel_for_each(workers, shapes, [&transforms](collision& col, display& dpy) {
+        if (!transforms.exists(col.parent)) return col.update_hull(dpy, nullptr);
+        transform t = transforms.get(col.parent).value();
+        col.update_hull(dpy, &t);
+    });
+
+    auto test_pair = [&](collision& col_a, collision& col_b) {
+        if (!teams_interact(col_a, col_b)) return;
+        pairs_tested++;
+        if (test_collision(col_a.shape, col_b.shape)) {
+            contacts.push_back(contact {col_a.parent, col_b.parent});
+        }
+    };
+
+    if (!use_broadphase) {
+        for (auto& col_a : collisions) {
+            auto col_it = pool<collision>::iterator(entity_index(col_a.parent) + 1, &collisions);
+            for (; col_it != collisions.end(); ++col_it) {
+                test_pair(col_a, *col_it);
             }
         }
+        return;
+    }
+
+    // Rebuild the grid from this tick's bounds, then only run SAT on pairs sharing a cell
+    grid.clear();
+    for (auto& col : collisions) {
+        //if (map_collision(dpy, data, col.get_tilemap_collision())) { contacts.push_back(contact {col.parent, data.parent}); }
+        if (col.shape.points.empty()) continue;
+        grid.insert(col.parent, col.shape.bounds);
     }
+    grid.for_each_pair([&](entity a, entity b) {
+        test_pair(collisions.get(a), collisions.get(b));
+    });
 }
 
 //////////////////////
 //     S_HEALTH     //
 //////////////////////
 
-void s_health::run(pool<health>& healths, pool<damage>& damages, entity_manager& entities) {
-    for(auto& damage : damages) {
-        if (damage.enemy_ID == 65535) continue;
-        entity enemy = damage.enemy_ID;
-        damage.enemy_ID = 65535;
-        if (!healths.exists(enemy)) continue;
+void s_health::run(pool<health>& healths, pool<damage>& damages, const std::vector<contact>& contacts, entity_manager& entities) {
+    auto hit = [&](entity source, entity target) {
+        if (!damages.exists(source)) return;
+        auto& damage = damages.get(source);
+        if (damage.destroy_on_hit) {
+            // Already spent on an earlier contact this tick
+            if (entities.marked(source)) return;
+            entities.mark_entity(source);
+        }
+        if (!healths.exists(target)) return;
 
-        auto& health = healths.get(enemy);
+        auto& health = healths.get(target);
         health.health -= damage.damage;
 
         if (health.has_healthbar)
-            set_entry(healthbar_atlas_indices[health.parent], health.health);
+            set_entry(health.healthbar_atlas_index, health.health);
 
         if (health.health <= 0) {
             regenerate = true;
             entities.mark_entity(health.parent);
         }
+    };
+
+    for (auto& c : contacts) {
+        hit(c.a, c.b);
+        hit(c.b, c.a);
     }
 }
 
@@ -297,12 +584,14 @@ void s_health::set_entry(u32 index, f32 val) {
     for (size_t i = start; i < start + 32 ; i ++) {
         tex->image_data.write(i, c);
     }
+    u16 width = tex->image_data.size().x;
+    mark_dirty(rect<u16>(point<u16>(0, start / width), size<u16>(width, 32 / width)));
 }
 
-void s_health::update_healthbars(pool<health>& healths, pool<display>& sprites) {
+void s_health::update_healthbars(view<health, display> healthbars) {
     size_t new_atlassize = 0;
 
-    for (auto& health : healths) {
+    for (auto [health, spr] : healthbars) {
         if (health.has_healthbar) new_atlassize++;
     }
 
@@ -315,18 +604,18 @@ void s_health::update_healthbars(pool<health>& healths, pool<display>& sprites)
     size<u16> tex_size = size<u16>(8, 4 * new_atlassize);
     tex->image_data = image(std::vector<u8>(tex_size.x * tex_size.y * 4), tex_size);
     tex->regions = size<u16>(1, new_atlassize);
+    mark_replaced();
 
     size<f32> slice_size(1, 1.0f / new_atlassize);
 
-    for (auto& health : healths) {
+    for (auto [health, spr] : healthbars) {
         if (health.has_healthbar == false) continue;
-        healthbar_atlas_indices[health.parent] = index;
+        health.healthbar_atlas_index = index;
 
-        display& spr = sprites.get(health.parent);
-        u32& sprite_index = healthbar_sprite_indices[health.parent];
+        u32& sprite_index = health.healthbar_sprite_index;
 
         // This is a new healthbar, not yet hooked up to a sprite
-        if (healthbar_sprite_indices[health.parent] == 0) {
+        if (sprite_index == 0) {
             sprite_coords tl = spr.get_dimensions().bottom_left() + sprite_coords(0, 0.1);
             sprite_index = spr.add_sprite(1, tex, 4, render_layers::sprites);
             size<f32> size(1, 0.25);
@@ -347,11 +636,11 @@ void s_health::update_healthbars(pool<health>& healths, pool<display>& sprites)
 //     S_PROXINTERACT     //
 ////////////////////////////
 
-bool test_proximity_collision(proximity& c, display& spr) {
+bool test_proximity_collision(proximity& c, rect<f32> bounds) {
     if(c.shape == proximity::shape::rectangle)
-        return AABB_collision(rect<f32>(c.origin, c.radii), spr.sprites(0).get_dimensions());
+        return AABB_collision(rect<f32>(c.origin, c.radii), bounds);
     if(c.shape == proximity::shape::elipse) {
-        world_coords p = spr.sprites(0).get_dimensions().center();
+        world_coords p = bounds.center();
         f32 left_side = pow(p.x - c.origin.x, 2) / pow(c.radii.x, 2);
         f32 right_side = pow(p.y - c.origin.y, 2) / pow(c.radii.y, 2);
         return left_side + right_side <= 1;
@@ -364,15 +653,14 @@ f32 distance(T a, T b) {
     return sqrt(pow(b.x - a.x, 2) + pow(b.y - a.y, 2));
 }
 
-void s_proxinteract::run(pool<proximity>& proximities, pool <widget>& widgets, display& player_spr) {
+void s_proxinteract::run(view<proximity, widget> interactables, rect<f32> player_bounds) {
     f32 min = 1000;
     entity current_min = 65535;
-    for(auto& proximity : proximities) {
-        if (!widgets.exists(proximity.parent)) continue;
-        if (widgets.get(proximity.parent).on_activate == nullptr) continue;
+    for(auto [proximity, widget] : interactables) {
+        if (widget.on_activate == nullptr) continue;
 
-        if (test_proximity_collision(proximity, player_spr)) {
-            f32 score = distance(proximity.origin, player_spr.sprites(0).get_dimensions().origin);
+        if (test_proximity_collision(proximity, player_bounds)) {
+            f32 score = distance(proximity.origin, player_bounds.origin);
             if (score < min) {
                 min = score;
                 current_min = proximity.parent;
@@ -386,23 +674,33 @@ void s_proxinteract::run(pool<proximity>& proximities, pool <widget>& widgets, d
 //     MISC. SYSTEMS     //
 ///////////////////////////
 
-void system_velocity_run(pool<velocity>& velocities, pool<display>& sprites, int framerate_multiplier) {
-    for (auto velocity : velocities) {
-        display& spr = sprites.get(velocity.parent);
-        sprite_coords new_velocity (velocity.delta.x / framerate_multiplier, velocity.delta.y / framerate_multiplier);
-        for (auto& sprite : spr) {
-            sprite.move_by(new_velocity);
+// Velocities are gathered a page at a time into arrays lined up with the transform page, with zero for entities
+// that don't move, so the whole page of positions can be updated with vector adds.
+void system_velocity_run(thread_pool& workers, pool<velocity>& velocities, pool<transform>& transforms, int framerate_multiplier) {
+    size_t num_words = std::min(velocities.num_words(), transforms.num_words());
+    parallel_for_words(workers, num_words, [&](size_t word) {
+        u64 bits = velocities.presence_word(word) & transforms.presence_word(word);
+        if (bits == 0) return;
+
+        alignas(16) std::array<f32, pool<transform>::page_size> dx {};
+        alignas(16) std::array<f32, pool<transform>::page_size> dy {};
+        for (; bits != 0; bits &= bits - 1) {
+            size_t slot = __builtin_ctzll(bits);
+            velocity& v = velocities.get(word * pool<transform>::page_size + slot);
+            dx[slot] = v.delta.x / framerate_multiplier;
+            dy[slot] = v.delta.y / framerate_multiplier;
         }
-    }
+        transforms.move_page(word, dx.data(), dy.data());
+    });
 }//     SOFTWARE TEXTURE MANAGAER CODE     //
 
 
-void s_shooting::run(pool<display>& sprites, pool<weapon_pool> weapons, player& p) {
+void s_shooting::run(pool<display>& sprites, pool<transform>& transforms, pool<weapon_pool>& weapons, player& p) {
     auto& pool =  weapons.get(p.parent);
     weapon_pool::weapon active = pool.weapons.get(pool.current);
     if (p.shoot == true && active.t.elapsed<timer::ms>() > timer::ms(active.stats.cooldown)) {
         bullet& b = bullet_types[active.stats.bullet];
-        shoot(b.tex, b.dimensions, b.speed, sprites.get(p.parent).get_dimensions().center(),
+        shoot(b.tex, b.dimensions, b.speed, world_bounds(sprites.get(p.parent), transforms).center(),
                      p.target, collision::flags::ally);
         active.t.start();
     }
@@ -424,13 +722,31 @@ void import_locale(std::unordered_map<std::string, std::string>& locale) {
     }
 }
 
+// Enough for every label a few menus' worth of UI shows, while a text box being typed into only keeps its recent edits
+constexpr size_t shaped_text_budget = 1024 * 1024;
+
 struct s_text::impl {
     FT_Library library;
     FT_Face face;
     hb_blob_t* blob = hb_blob_create_from_file("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
     hb_font_t* font;
+    glyph_cache glyphs;
+    shaping_cache shaped {shaped_text_budget};
+    size_t strings_shaped = 0;
+
+    // What each entry's strip of the atlas was last drawn with, in the order entries are laid out
+    struct strip {
+        std::string text;
+        color text_color;
+        size<f32> area;
+    };
+    std::vector<strip> strips;
 
     std::unordered_map<std::string, std::string> locale_lookup;
+
+    f32 line_height() { return glyphs.get_char(face, '|').bitmap_size.y * 1.15; }
+    // Shapes and wraps the text the first time it's seen, and returns the cached result afterwards
+    const shaped_text& shape(const std::string& text);
 };
 
 s_text::s_text() {
@@ -438,6 +754,9 @@ s_text::s_text() {
     FT_Init_FreeType(&data->library );
     FT_New_Face(data->library, "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf", 0, &data->face);
     FT_Set_Char_Size( data->face, 16 * 64, 0, 100, 0 );
+    FT_Int spread = distance_field_spread;
+    FT_Property_Set(data->library, "sdf", "spread", &spread);
+    FT_Property_Set(data->library, "bsdf", "spread", &spread);
     import_locale(data->locale_lookup);
     data->font = hb_ft_font_create_referenced(data->face);
     hb_ft_font_set_funcs(data->font);
@@ -445,7 +764,7 @@ s_text::s_text() {
 
 struct harfbuzz_buffer {
 public:
-    harfbuzz_buffer(std::string text, hb_font_t* font) {
+    harfbuzz_buffer(const std::string& text, hb_font_t* font) {
         buf = hb_buffer_create();
         hb_buffer_set_direction(buf, HB_DIRECTION_LTR);
         hb_buffer_set_script(buf, HB_SCRIPT_LATIN);
@@ -459,8 +778,9 @@ public:
     ~harfbuzz_buffer() { hb_buffer_destroy(buf); }
 
     u32 glyph_count() { return _glyph_count; }
+    u32 glyph_id(size_t i) { return glyph_info[i].codepoint; }
     sprite_coords glyph_advance(size_t i) { return sprite_coords(glyph_pos[i].x_advance / 64.0f, glyph_pos[i].y_advance / 64.0f); }
-    sprite_coords glyph_offset(size_t i) { return sprite_coords(glyph_pos[i].x_offset / 64.0f, glyph_pos[i].x_offset / 64.0f); }
+    sprite_coords glyph_offset(size_t i) { return sprite_coords(glyph_pos[i].x_offset / 64.0f, glyph_pos[i].y_offset / 64.0f); }
 private:
     u32 _glyph_count;
     hb_buffer_t* buf;
@@ -472,18 +792,42 @@ private:
 };
 
 
+// Creating a break iterator loads ICU's rules for it, which costs far more than using one. Each thread keeps one of
+// each kind for good, and points it at whatever text it's asked about next.
+struct break_iterators {
+    std::unique_ptr<icu::BreakIterator> characters;
+    std::unique_ptr<icu::BreakIterator> lines;
+
+    break_iterators() {
+        UErrorCode status = U_ZERO_ERROR;
+        characters.reset(icu::BreakIterator::createCharacterInstance(icu::Locale::getUS(), status));
+        lines.reset(icu::BreakIterator::createLineInstance(icu::Locale::getUS(), status));
+    }
+};
+
+break_iterators& thread_break_iterators() {
+    thread_local break_iterators iterators;
+    return iterators;
+}
+
+std::vector<int> find_graphemes(const icu::UnicodeString& s) {
+    icu::BreakIterator* char_locations = thread_break_iterators().characters.get();
+    char_locations->setText(s);
+    std::vector<int> graphemes;
+    for (int index = char_locations->first(); index != icu::BreakIterator::DONE; index = char_locations->next()) {
+        graphemes.push_back(index);
+    }
+    return graphemes;
+}
+
 // Break the string into lines of roughly 50 characters, then perform word wrapping and generate a new set of newlines.
-std::vector<int> s_text::get_numlines(std::string& text) {
-    icu::UnicodeString s(text.c_str());
-    UErrorCode status = U_ZERO_ERROR;
-    icu::BreakIterator* char_locations = icu::BreakIterator::createCharacterInstance(icu::Locale::getUS(), status);
+std::vector<int> break_lines(const std::string& text, const icu::UnicodeString& s, const shaped_text& shaped, glyph_cache& glyphs, FT_Face face) {
+    icu::BreakIterator* char_locations = thread_break_iterators().characters.get();
     char_locations->setText(s);
-    icu::BreakIterator* linebreak_locations = icu::BreakIterator::createLineInstance(icu::Locale::getUS(), status);
+    icu::BreakIterator* linebreak_locations = thread_break_iterators().lines.get();
     linebreak_locations->setText(s);
 
-    harfbuzz_buffer buffer(text, data->font);
-    FT_Load_Char(data->face, '|', FT_LOAD_RENDER);
-    f32 lineheight = (data->face)->glyph->bitmap.rows * 1.15;
+    size_t num_glyphs = std::min(text.size(), shaped.glyph_count());
     screen_coords box_size(0, 0);
     u16 row_size = 0;
     std::vector<int> line_indices;
@@ -491,16 +835,16 @@ std::vector<int> s_text::get_numlines(std::string& text) {
     int next_break = 50;
 
     // Gather newlines, while calculating the size of the box required to display this data pre-word wrapping
-    for (int i = 0; i < text.size(); i++) {
-        row_size += buffer.glyph_advance(i).x;
-        if (i == break_index) {
+    for (size_t i = 0; i < num_glyphs; i++) {
+        row_size += shaped.advances[i].x;
+        if (break_index != icu::BreakIterator::DONE && i == size_t(break_index)) {
             int preceeding_char = char_locations->preceding(break_index);
             if (preceeding_char >= next_break && preceeding_char != icu::BreakIterator::DONE) {
                 int new_newline = linebreak_locations->preceding(break_index + 1);
-                if (new_newline < text.size() && new_newline != 0) {
+                if (new_newline > 0 && size_t(new_newline) < text.size()) {
                     line_indices.emplace_back(new_newline);
-                    FT_Load_Char(data->face, text[i], FT_LOAD_RENDER);
-                    box_size.x = std::max(box_size.x, u16(row_size + (data->face)->glyph->bitmap.width - buffer.glyph_advance(i).x));
+                    u16 glyph_width = glyphs.get(face, shaped.glyph_ids[i]).bitmap_size.x;
+                    box_size.x = std::max(box_size.x, u16(row_size + glyph_width - shaped.advances[i].x));
                     row_size = 0;
                 }
                 next_break = new_newline + 50;
@@ -509,17 +853,16 @@ std::vector<int> s_text::get_numlines(std::string& text) {
         }
     }
 
-    int index = 0;
+    size_t index = 0;
     screen_coords new_box_size(0, 0);
     row_size = 0;
     linebreak_locations->first();
     std::vector<int> new_linebreaks;
     for (size_t line_index : line_indices) {
-        for (index; index < std::min(text.size(), line_index); index++) {
-            row_size += buffer.glyph_advance(index).x;
+        for (index; index < std::min(num_glyphs, line_index); index++) {
+            row_size += shaped.advances[index].x;
         }
 
-        FT_Load_Char(data->face, text[index], FT_LOAD_RENDER);
         bool loop = true;
         // attempt to bring words from the next line up to this one
         int word_width = 0;
@@ -531,8 +874,8 @@ std::vector<int> s_text::get_numlines(std::string& text) {
                 break;
             };
 
-            for (int i = index; i < new_newline; i++) {
-                word_width += buffer.glyph_advance(i).x;
+            for (size_t i = index; i < std::min(num_glyphs, new_newline); i++) {
+                word_width += shaped.advances[i].x;
             }
 
             if (row_size + word_width < box_size.x + (box_size.x / 90.0)) {
@@ -548,38 +891,72 @@ std::vector<int> s_text::get_numlines(std::string& text) {
     return new_linebreaks;
 }
 
-void write_glyph(image& atlas, FT_Bitmap* bmp, point<u16> pen, color text_color) {
-     for(size_t y = 0; y < bmp->rows; y++) {
-         for (size_t x = 0; x < bmp->width; x++) {
-             size_t src_index = (x + (y * (bmp->width)));
-             size_t dst_index = ((x + pen.x) + ((y + pen.y) * atlas.size().x));
-             if (dst_index >= (atlas.size().x * atlas.size().y) || src_index >= bmp->rows * bmp->width) continue;
-             atlas.write(dst_index, color(text_color.r, text_color.g, text_color.b, bmp->buffer[src_index]));
-         }
-     }
+const shaped_text& s_text::impl::shape(const std::string& text) {
+    u32 pixel_size = face->size->metrics.y_ppem;
+    if (const shaped_text* found = shaped.find(text, font, pixel_size)) return *found;
+
+    strings_shaped++;
+    harfbuzz_buffer buffer(text, font);
+    shaped_text result;
+    for (size_t i = 0; i < buffer.glyph_count(); i++) {
+        result.glyph_ids.push_back(buffer.glyph_id(i));
+        result.advances.push_back(buffer.glyph_advance(i));
+        result.offsets.push_back(buffer.glyph_offset(i));
+    }
+    icu::UnicodeString s(text.c_str());
+    result.line_breaks = break_lines(text, s, result, glyphs, face);
+    result.graphemes = find_graphemes(s);
+    return shaped.insert(text, font, pixel_size, std::move(result));
 }
 
-void s_text::render_line(std::string text, point<u16> pen, color text_color) {
-    harfbuzz_buffer buffer(text, data->font);
+std::vector<int> s_text::get_numlines(std::string& text) {
+    return data->shape(text).line_breaks;
+}
 
-    FT_Load_Char(data->face, '|', FT_LOAD_RENDER);
-    f32 lineheight = (data->face)->glyph->bitmap.rows * 1.15;
+void write_glyph(image& atlas, const u8* coverage, size<u16> glyph_size, point<i32> pen, rect<i32> clip, color text_color) {
+    for (i32 y = std::max(0, clip.origin.y - pen.y); y < std::min<i32>(glyph_size.y, clip.origin.y + clip.size.y - pen.y); y++) {
+        for (i32 x = std::max(0, clip.origin.x - pen.x); x < std::min<i32>(glyph_size.x, clip.origin.x + clip.size.x - pen.x); x++) {
+            u8 alpha = coverage[x + y * glyph_cache::page_size];
+            if (alpha == 0) continue;
+            atlas.write((x + pen.x) + (y + pen.y) * atlas.size().x, color(text_color.r, text_color.g, text_color.b, alpha));
+        }
+    }
+}
 
-    auto newlines = get_numlines(text);
-    int index = 0;
-    int i = newlines.size();
-    for (size_t line_index : newlines) {
-        for (index; index < std::min(text.size(), line_index); index++) {
-            auto error = FT_Load_Char(data->face, text[index], FT_LOAD_RENDER);
-            if (error) continue;
+// Distance fields reach past the outline, so neighbouring glyphs overlap. Where they do, the nearer edge wins. Color
+// is written under the whole field, so filtering near the edge never mixes in the cleared background.
+void write_distance_field(image& atlas, const u8* distances, size<u16> glyph_size, point<i32> pen, rect<i32> clip, color text_color) {
+    for (i32 y = std::max(0, clip.origin.y - pen.y); y < std::min<i32>(glyph_size.y, clip.origin.y + clip.size.y - pen.y); y++) {
+        for (i32 x = std::max(0, clip.origin.x - pen.x); x < std::min<i32>(glyph_size.x, clip.origin.x + clip.size.x - pen.x); x++) {
+            size_t index = (x + pen.x) + (y + pen.y) * atlas.size().x;
+            u8 distance = std::max(distances[x + y * glyph_cache::page_size], atlas.data()[index * 4 + 3]);
+            atlas.write(index, color(text_color.r, text_color.g, text_color.b, distance));
+        }
+    }
+}
 
-            sprite_coords offset = buffer.glyph_offset(index);
-            sprite_coords advance = buffer.glyph_advance(index);
-            int top =  data->face->glyph->bitmap_top;
-            float x0 = pen.x + offset.x + data->face->glyph->bitmap_left;
-            float y0 = floor(pen.y + offset.y + (lineheight - 5 - data->face->glyph->bitmap_top));
+// Glyphs are clipped to the strip the line is drawn in, so redrawing a strip never leaves parts of glyphs in the next
+void s_text::render_line(std::string text, point<u16> pen, u16 strip_height, color text_color) {
+    const shaped_text& shaped = data->shape(text);
+    f32 lineheight = data->line_height();
+    rect<i32> clip(point<i32>(0, pen.y), size<i32>(tex->image_data.size().x, std::min<i32>(strip_height, tex->image_data.size().y - pen.y)));
+    auto glyph_format = distance_field ? glyph_cache::format::distance_field : glyph_cache::format::coverage;
 
-            write_glyph(tex->image_data, &data->face->glyph->bitmap, point<u16>(x0, y0), text_color);
+    size_t index = 0;
+    for (size_t line_index : shaped.line_breaks) {
+        for (index; index < std::min(shaped.glyph_count(), line_index); index++) {
+            // Glyphs come from the cache, so only ones never seen before are rasterized
+            const glyph_cache::glyph& glyph = data->glyphs.get(data->face, shaped.glyph_ids[index], glyph_format);
+            sprite_coords offset = shaped.offsets[index];
+            sprite_coords advance = shaped.advances[index];
+            float x0 = pen.x + offset.x + glyph.bearing.x;
+            float y0 = floor(pen.y + offset.y + (lineheight - 5 - glyph.bearing.y));
+
+            if (distance_field) {
+                write_distance_field(tex->image_data, data->glyphs.coverage(glyph), glyph.bitmap_size, point<i32>(x0, y0), clip, text_color);
+            } else {
+                write_glyph(tex->image_data, data->glyphs.coverage(glyph), glyph.bitmap_size, point<i32>(x0, y0), clip, text_color);
+            }
             pen += advance.to<u16>();
         }
         pen.x = 0;
@@ -587,6 +964,9 @@ void s_text::render_line(std::string text, point<u16> pen, color text_color) {
     }
 }
 
+size_t s_text::glyphs_rasterized() { return data->glyphs.glyphs_rasterized; }
+size_t s_text::strings_shaped() { return data->strings_shaped; }
+
 std::string s_text::replace_locale_macro(std::string& text) {
     auto it = data->locale_lookup.find(text);
     if (it == data->locale_lookup.end()) {
@@ -596,81 +976,120 @@ std::string s_text::replace_locale_macro(std::string& text) {
     }
 }
 
-void s_text::run(pool<text>& texts, pool<display>& displays) {
+// Whether a sprite of this size shows a strip of the other only scaled, the way resize_ui scales every quad
+static bool scaled_from(sprite_coords strip, sprite_coords sprite) {
+    if (strip.x <= 0 || strip.y <= 0) return false;
+    return std::abs(strip.x * sprite.y - strip.y * sprite.x) <= 0.001f * strip.x * sprite.y;
+}
+
+// Every entry gets a strip of the atlas, one under the other. While entries keep their sizes, strips keep their place,
+// and only strips whose text or color changed are cleared and drawn again. Distance field strips keep the size they
+// were first laid out at when their sprite is scaled, through later relayouts too, and are stretched over it.
+void s_text::run(view<text, display> texts) {
     size<f32> atlas_size(0, 0);
-    int num_text_entries = 0;
-    for(auto& text : texts) {
-        for (auto entry : text.text_entries) {
+    size_t num_text_entries = 0;
+    bool relayout = regenerate;
+    for(auto [text, dpy] : texts) {
+        sprite_data& sprite = dpy.sprites(text.sprite_index);
+        for (auto& entry : text.text_entries) {
             if (entry.text == "") continue;
-            auto dim = displays.get(text.parent).sprites(text.sprite_index).get_dimensions(entry.quad_index);
-            atlas_size.y += dim.size.y;
-            atlas_size.x = std::max(dim.size.x, atlas_size.x);
+            auto dim = sprite.get_dimensions(entry.quad_index);
+            if (!distance_field || !scaled_from(entry.strip_size, dim.size)) entry.strip_size = dim.size;
+            // New sprites don't show the atlas yet, and need their UVs set
+            if (num_text_entries >= data->strips.size() || sprite.tex != tex) relayout = true;
+            else if (data->strips[num_text_entries].area != entry.strip_size) relayout = true;
+            atlas_size.y += entry.strip_size.y;
+            atlas_size.x = std::max(entry.strip_size.x, atlas_size.x);
             num_text_entries++;
-            if (entry.regen) {
-                regenerate = true;
-                entry.regen = false;
-            }
         }
     }
 
-    if (num_text_entries != last_atlassize) regenerate = true;
-    last_atlassize = num_text_entries;
-    if (num_text_entries == 0 || regenerate == false) return;
+    if (num_text_entries != data->strips.size()) relayout = true;
+    if (num_text_entries == 0) {
+        data->strips.clear();
+        return;
+    }
 
-    tex->image_data = image(std::vector<u8>(atlas_size.x * atlas_size.y * 4, 0), atlas_size.to<u16>());
+    if (relayout) {
+        tex->image_data = image(std::vector<u8>(atlas_size.x * atlas_size.y * 4, 0), atlas_size.to<u16>());
+        tex->distance_field = distance_field;
+        mark_replaced();
+        data->strips.clear();
+    }
+    image& atlas = tex->image_data;
     point<u16> pen(0, 0);
+    size_t strip_index = 0;
 
-    for(auto text : texts) {
-        for (auto entry : text.text_entries) {
+    for(auto [text, dpy] : texts) {
+        sprite_data& sprite = dpy.sprites(text.sprite_index);
+        for (auto& entry : text.text_entries) {
             if (entry.text == "") continue;
-            render_line(replace_locale_macro(entry.text), pen, entry.text_color);
-            auto text_dim = displays.get(text.parent).sprites(text.sprite_index).get_dimensions(entry.quad_index);
-            point<f32> uv_pos(0, pen.y / static_cast<f32>(atlas_size.y));
-            size<f32> uv_size(text_dim.size.x / static_cast<f32>(atlas_size.x), text_dim.size.y / static_cast<f32>(atlas_size.y));
-            displays.get(text.parent).sprites(text.sprite_index).set_uv(uv_pos, uv_size, entry.quad_index);
-            pen.y += text_dim.size.y;
+            if (relayout) {
+                point<f32> uv_pos(0, pen.y / static_cast<f32>(atlas.size().y));
+                size<f32> uv_size(entry.strip_size.x / static_cast<f32>(atlas.size().x), entry.strip_size.y / static_cast<f32>(atlas.size().y));
+                sprite.set_uv(uv_pos, uv_size, entry.quad_index);
+                data->strips.push_back(impl::strip {"", entry.text_color, entry.strip_size});
+            }
+
+            impl::strip& strip = data->strips[strip_index++];
+            if (relayout || entry.regen || strip.text != entry.text || strip.text_color != entry.text_color) {
+                if (!relayout) {
+                    size_t strip_end = std::min<size_t>(atlas.size().y, pen.y + strip.area.y);
+                    std::fill(atlas.data().begin() + size_t(pen.y) * atlas.size().x * 4, atlas.data().begin() + strip_end * atlas.size().x * 4, 0);
+                }
+                render_line(replace_locale_macro(entry.text), pen, strip.area.y, entry.text_color);
+                if (!relayout) {
+                    u16 strip_height = std::min<i32>(strip.area.y, atlas.size().y - pen.y);
+                    mark_dirty(rect<u16>(point<u16>(0, pen.y), size<u16>(atlas.size().x, strip_height)));
+                }
+                strip.text = entry.text;
+                strip.text_color = entry.text_color;
+                entry.regen = false;
+            }
+            pen.y += strip.area.y;
+        }
+        if (relayout) {
+            sprite.tex = tex;
+            sprite.z_index = 9;
         }
-        displays.get(text.parent).sprites(text.sprite_index).tex = tex;
-        displays.get(text.parent).sprites(text.sprite_index).z_index = 9;
     }
     regenerate = false;
 }
 
 screen_coords s_text::get_text_size(std::string& text_in) {
     std::string text = replace_locale_macro(text_in);
-    harfbuzz_buffer buffer(text, data->font);
-    FT_Load_Char(data->face, '|', FT_LOAD_RENDER);
-    f32 lineheight = data->face->glyph->bitmap.rows * 1.15;
-    auto newlines = get_numlines(text);
-    int index = 0;
-    screen_coords box_size(0, lineheight * (newlines.size()));
-    for (size_t line_index : newlines) {
+    const shaped_text& shaped = data->shape(text);
+    f32 lineheight = data->line_height();
+    if (shaped.glyph_count() == 0) return screen_coords(0, lineheight);
+
+    size_t index = 0;
+    screen_coords box_size(0, lineheight * (shaped.line_breaks.size()));
+    for (size_t line_index : shaped.line_breaks) {
         u16 row_size = 0;
-        for (index; index < std::min(line_index - 1, text.size() - 1); index++) {
-            row_size += buffer.glyph_advance(index).x;
+        for (index; index < std::min(line_index - 1, shaped.glyph_count() - 1); index++) {
+            row_size += shaped.advances[index].x;
         }
-        FT_Load_Char(data->face, text[index], FT_LOAD_RENDER);
-        box_size.x = std::max(u32(box_size.x), row_size + (data->face)->glyph->bitmap.width);
+        box_size.x = std::max(u32(box_size.x), u32(row_size + data->glyphs.get(data->face, shaped.glyph_ids[index]).bitmap_size.x));
     }
     return box_size;
 }
 
 size_t s_text::character_at_position(std::string text_in, screen_coords pos) {
     std::string text = replace_locale_macro(text_in);
-    harfbuzz_buffer buffer(text, data->font);
-    FT_Load_Char(data->face, '|', FT_LOAD_RENDER);
-    f32 lineheight = data->face->glyph->bitmap.rows * 1.15;
-    auto newlines = get_numlines(text);
-    int index = 0;
+    const shaped_text& shaped = data->shape(text);
+    f32 lineheight = data->line_height();
+    if (shaped.glyph_count() == 0) return text.size();
+
+    size_t index = 0;
     screen_coords cursor(0, 0);
-    for (size_t line_index : newlines) {
-        for (index; index < std::min(line_index - 1, text.size() - 1); index++) {
+    for (size_t line_index : shaped.line_breaks) {
+        for (index; index < std::min(line_index - 1, shaped.glyph_count() - 1); index++) {
             if (pos.y >= cursor.y && pos.y <= cursor.y + lineheight) {
-                if (pos.x >= cursor.x && pos.x <= cursor.x + buffer.glyph_advance(index).x) {
+                if (pos.x >= cursor.x && pos.x <= cursor.x + shaped.advances[index].x) {
                     return index;
                 }
             }
-            cursor.x += buffer.glyph_advance(index).x;
+            cursor.x += shaped.advances[index].x;
         }
         cursor.y += lineheight;
         cursor.x = 0;
@@ -680,16 +1099,14 @@ size_t s_text::character_at_position(std::string text_in, screen_coords pos) {
 
 screen_coords s_text::position_of_character(std::string text_in, size_t pos) {
     std::string text = replace_locale_macro(text_in);
-    harfbuzz_buffer buffer(text, data->font);
-    FT_Load_Char(data->face, '|', FT_LOAD_RENDER);
-    f32 lineheight = data->face->glyph->bitmap.rows * 1.15;
-    auto newlines = get_numlines(text);
-    int index = 0;
+    const shaped_text& shaped = data->shape(text);
+    f32 lineheight = data->line_height();
+    size_t index = 0;
     screen_coords box_size(0, 0);
-    for (size_t line_index : newlines) {
+    for (size_t line_index : shaped.line_breaks) {
         u16 row_size = 0;
-        for (index; index < std::min(line_index, pos); index++) {
-            row_size += buffer.glyph_advance(index).x;
+        for (index; index < std::min({line_index, pos, shaped.glyph_count()}); index++) {
+            row_size += shaped.advances[index].x;
         }
         box_size.y += lineheight;
         box_size.x = std::max(box_size.x, row_size);
@@ -701,44 +1118,29 @@ screen_coords s_text::position_of_character(std::string text_in, size_t pos) {
 
 int s_text::num_characters(std::string text_in) {
     std::string text = replace_locale_macro(text_in);
-    icu::UnicodeString s(text.c_str());
-    UErrorCode status = U_ZERO_ERROR;
-    icu::BreakIterator* char_locations = icu::BreakIterator::createCharacterInstance(icu::Locale::getUS(), status);
-    char_locations->setText(s);
-
-    int char_index = 0;
-    int num_breaks = 0;
-    while (char_index != icu::BreakIterator::DONE) {
-        num_breaks++;
-        char_index = char_locations->next();
-    }
-    return num_breaks;
+    return data->shape(text).graphemes.size();
 }
 
 int s_text::bytes_of_character(std::string text_in, int char_in) {
     std::string text = replace_locale_macro(text_in);
-    icu::UnicodeString s(text.c_str());
-    UErrorCode status = U_ZERO_ERROR;
-    icu::BreakIterator *char_locations = icu::BreakIterator::createCharacterInstance(icu::Locale::getUS(), status);
-    char_locations->setText(s);
-    char_locations->first();
+    const std::vector<int>& graphemes = data->shape(text).graphemes;
+    size_t index = std::max(char_in, 0);
+    if (index >= graphemes.size()) return text.size() - 1;
 
-    int lpos = char_locations->next(char_in);
-    lpos = lpos == -1 ? 0 : lpos;
-    int rpos = char_locations->next();
-    rpos = rpos == -1 ? text.size() - 1 : rpos;
+    int lpos = graphemes[index];
+    int rpos = index + 1 < graphemes.size() ? graphemes[index + 1] : text.size() - 1;
     return rpos - lpos;
 }
 
 
 int s_text::character_byte_index(std::string text_in, int char_in) {
     std::string text = replace_locale_macro(text_in);
-    icu::UnicodeString s(text.c_str());
-    UErrorCode status = U_ZERO_ERROR;
-    icu::BreakIterator *char_locations = icu::BreakIterator::createCharacterInstance(icu::Locale::getUS(), status);
-    char_locations->setText(s);
+    const std::vector<int>& graphemes = data->shape(text).graphemes;
+    int following = char_in < 0 ? 0 : icu::BreakIterator::DONE;
+    auto next = std::upper_bound(graphemes.begin(), graphemes.end(), char_in);
+    if (char_in >= 0 && next != graphemes.end()) following = *next;
 
-    int byte_index = char_locations->following(char_in) - 1;
+    int byte_index = following - 1;
     return byte_index == -1 ? text_in.size() - 1 : byte_index;
 }
 
@@ -7,29 +7,56 @@
 
 #include <common/graphical_types.h>
 #include <common/marked_storage.h>
+#include <common/paged_storage.h>
+#include <common/sparse_storage.h>
+#include <common/spatial_hash.h>
+#include <common/thread_pool.h>
 #include <functional>
 #include <vector>
-#include <mutex>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <algorithm>
 
 class engine;
 namespace ecs {
 
-class entity_manager {
+// Entity indices are 16 bits, and the last one is reserved for null_entity
+static constexpr u32 max_entities = 65535;
+
+// Destruction is deferred: entities are marked during a tick from any thread, and destroyed together by remove_marked.
+// Each thread marks into its own buffer without locking, and a bit per index drops duplicate marks, e.g. a bullet hitting twice.
+class entity_manager : no_copy, no_move {
 public:
-	constexpr static auto max_entites = 128;
 	entity_manager();
+	~entity_manager();
 	entity add_entity();
 	void mark_entity(entity id);
-	std::vector<entity> remove_marked();
+	// True if the entity has been marked since the last remove_marked
+	bool marked(entity id) { return alive(id) && (marked_indices[entity_index(id) / 64] & (1ull << (entity_index(id) % 64))) != 0; }
+	// Must not run concurrently with mark_entity. The returned list is reused by the next call.
+	const std::vector<entity>& remove_marked();
+	// False once the entity has been destroyed, even if its index has since been reused
+	bool alive(entity id) { return entity_index(id) < generations.size() && generations[entity_index(id)] == entity_generation(id); }
+	size_t num_alive() { return generations.size() - entity_freelist.size(); }
 private:
-	constexpr static u8 bucket_count = 4;
-	struct bucket {
-		std::mutex mutex;
-		std::vector <entity> ids;
+	struct mark_buffer {
+		std::vector<entity> ids;
+		std::thread::id owner;
+		mark_buffer* next = nullptr;
 	};
-	std::array<bucket, 4> buckets;
-	std::vector <u32> entity_freelist;
-	std::size_t get_thread_id() noexcept;
+	std::atomic<mark_buffer*> mark_buffers = nullptr; // Lock-free list of every thread's buffer, pushed at the front
+	std::array<std::atomic<u64>, (max_entities + 63) / 64> marked_indices {}; // Entity indices marked since the last remove_marked
+	std::vector<entity> destroyed;
+	// Indices are reused newest first, while their components are likely still in cache.
+	// Capacity for every index is reserved up front, so ticks never allocate here.
+	std::vector<u32> entity_freelist;
+	std::vector<u16> generations; // Current generation of every index handed out so far
+	u64 serial; // Tells managers apart in per-thread buffer caches, even if one reuses another's address
+
+	mark_buffer& thread_buffer();
 };
 
 ///////////////////////////////////////////////////////////////
@@ -61,6 +88,14 @@ struct velocity : public component {
 	sprite_coords delta;
 };
 
+// Where an entity sits in the world. Sprites of an entity with a transform are laid out in its local space,
+// and only placed in the world when they're submitted for rendering: scaled, rotated about the local origin, then moved.
+struct transform : public component {
+	world_coords position;
+	f32 rotation = 0; // Radians
+	world_coords scale {1, 1};
+};
+
 struct collision : public component {
 	enum flags : u8 {
 		// damage teams
@@ -72,9 +107,31 @@ struct collision : public component {
 		ground = 64,
 		air = 128,
 	};
-	std::function<void(u32)> on_collide;
-	std::vector <sprite_id> disabled_sprites; // Some sprites shouldn't have hitboxes e.g. healthbars
+	// Collision shape cached from the parent's display. Only rebuilt when a sprite's vertices change, or sprites are
+	// enabled or disabled for collision.
+	struct hull {
+		struct axis {
+			world_coords normal;
+			f32 min, max; // This hull's own projection onto the normal
+		};
+		std::vector<world_coords> points;
+		std::vector<axis> axes;
+		rect<f32> bounds;
+		bool axis_aligned = true;
+		u64 revision = ~0ull;
+		size_t num_sprites = 0;
+		std::bitset<32> disabled_sprites;
+
+		void compute_bounds();
+		void compute_projections();
+	};
+
+	std::bitset<32> disabled_sprites; // Some sprites shouldn't have hitboxes e.g. healthbars
+	hull local; // From the display as laid out, in the entity's local space
+	hull shape; // Placed in the world by the entity's transform, or the same as local without one
 
+	bool sprite_has_collision(sprite_id);
+	void update_hull(display&, const transform*);
 	void set_team_detector(flags);
 	u8 get_team_detectors();
 	void set_team_signal(flags);
@@ -154,11 +211,13 @@ struct health : public component {
 	f32 health = 50;
 	f32 max_health = 50;
 	bool has_healthbar = false;
+	u32 healthbar_sprite_index = 0; // 0 until s_health hooks a healthbar sprite up
+	u32 healthbar_atlas_index = 0;
 };
 
 struct damage : public component {
-	entity enemy_ID = 65535;
-	int damage;
+	int damage = 0;
+	bool destroy_on_hit = false; // Projectiles hit once, then get destroyed
 };
 
 /////////////////////////////////
@@ -190,6 +249,8 @@ struct text : public component {
 		std::string text = "";
 		color text_color = color(0, 0, 0, 0);
 		bool regen = false;
+		// Size of the atlas strip the text is drawn in. Distance field text keeps it while its sprite is only scaled.
+		sprite_coords strip_size {0, 0};
 	};
 	u8 sprite_index = 0;
 	std::vector <text_entry> text_entries;
@@ -239,23 +300,176 @@ struct dropdown : public component {
 //     COMPONENT MANAGER     //
 ///////////////////////////////
 
-static constexpr u32 max_entities = 128;
+// Each component type picks its storage in ALL_COMPONENTS:
+//     paged  - growable marked storage. References stay valid, so use it for anything held by reference while other entities are added
+//     sparse - sparse set, packed for iteration and sized by usage. Adding or removing moves elements, so don't hold references across those
+//     soa    - structure of arrays, for transform only. pool<transform> is specialised below
+#define ALL_COMPONENTS(m)\
+    m(display, paged) m(collision, paged) m(velocity, sparse) m(transform, soa) m(proximity, sparse)\
+    m(health, paged) m(damage, paged) m(weapon_pool, sparse) \
+    m(enemy, sparse)\
+    m(player, sparse) m(inventory, sparse) m(mapdata, sparse)\
+    m(widget, paged) m(selection, paged) m(text, paged) m(checkbox, sparse) m(slider, sparse) m(button, sparse) m(dropdown, sparse)\
+
 template<typename T>
-using pool = marked_storage<T, max_entities>;
+struct pool_storage;
+template<typename T>
+class soa_storage;
+#define GENERATE_STORAGE_TRAITS(T, storage) template<> struct pool_storage<T> { using type = storage ## _storage<T>; };
+ALL_COMPONENTS(GENERATE_STORAGE_TRAITS)
+
+// Component pools are indexed by entity index. Lookups also match the component's parent against the full handle,
+// so a stale handle whose index was recycled doesn't alias the new entity's components.
+template<typename T>
+class pool : public pool_storage<T>::type {
+	using storage = typename pool_storage<T>::type;
+public:
+	bool exists(entity e) const {
+		return storage::exists(entity_index(e)) && static_cast<const component&>(storage::get(entity_index(e))).parent == e;
+	}
+	T& get(entity e) { return storage::get(entity_index(e)); }
+	void remove(entity e) { if (exists(e)) storage::remove(entity_index(e)); }
+	T& add(entity e, const T c) {
+		T& added = storage::add(entity_index(e), c);
+		static_cast<component&>(added).parent = e;
+		return added;
+	}
+};
+
+// Transforms are stored as a structure of arrays in pages of 64, so systems can move a page of them with vector instructions.
+// The fields of a transform don't live together, so get() and add() hand out a reference object rather than a transform&.
+template<>
+class pool<transform> {
+public:
+	static constexpr size_t page_size = 64;
+	struct page {
+		u64 markers = 0;
+		std::array<entity, page_size> parents {};
+		alignas(16) std::array<f32, page_size> x {};
+		alignas(16) std::array<f32, page_size> y {};
+		alignas(16) std::array<f32, page_size> rotation {};
+		alignas(16) std::array<f32, page_size> scale_x {};
+		alignas(16) std::array<f32, page_size> scale_y {};
+	};
+
+	class reference {
+	public:
+		reference(page& p, size_t slot) : _page(&p), _slot(slot) {}
+		world_coords position() const { return world_coords(_page->x[_slot], _page->y[_slot]); }
+		f32 rotation() const { return _page->rotation[_slot]; }
+		world_coords scale() const { return world_coords(_page->scale_x[_slot], _page->scale_y[_slot]); }
+		transform value() const;
+
+		void set_position(world_coords pos) { _page->x[_slot] = pos.x; _page->y[_slot] = pos.y; }
+		void set_rotation(f32 theta) { _page->rotation[_slot] = theta; }
+		void set_scale(world_coords scale) { _page->scale_x[_slot] = scale.x; _page->scale_y[_slot] = scale.y; }
+		void move_by(world_coords delta) { set_position(position() + delta); }
+	private:
+		page* _page;
+		size_t _slot;
+	};
+
+	bool exists(entity e) const {
+		size_t index = entity_index(e);
+		if (index / page_size >= _pages.size() || !_pages[index / page_size]) return false;
+		const page& p = *_pages[index / page_size];
+		return (p.markers & (1ull << (index % page_size))) != 0 && p.parents[index % page_size] == e;
+	}
+	// To avoid extraneous testing, no validity checks are performed here
+	reference get(entity e) { return reference(*_pages[entity_index(e) / page_size], entity_index(e) % page_size); }
+	reference add(entity e, const transform t);
+	void remove(entity e);
+	size_t size() const { return _count; }
+	size_t num_words() const { return _pages.size(); }
+	u64 presence_word(size_t word) const { return _pages[word] ? _pages[word]->markers : 0; }
+	// Adds dx[i] and dy[i] to the position in slot i of a page, for all 64 slots
+	void move_page(size_t word, const f32* dx, const f32* dy);
+private:
+	std::vector<std::unique_ptr<page>> _pages;
+	size_t _count = 0;
+};
+
 template<typename T>
 struct type_tag {};
 
-#define ALL_COMPONENTS(m)\
-    m(display) m(collision) m(velocity) m(proximity)\
-    m(health) m(damage) m(weapon_pool) \
-    m(enemy)\
-    m(player) m(inventory) m(mapdata)\
-    m(widget) m(selection) m(text) m(checkbox) m(slider) m(button) m(dropdown)\
+// Joins several pools, visiting only entities that have every component, and yields a tuple of references to them.
+// The pools' presence words are ANDed together, so each 64 entities cost one AND per pool rather than a lookup each.
+template<typename... Ts>
+class view {
+public:
+	view(pool<Ts>&... pools_in) : pools(pools_in...) {}
+
+	class iterator {
+	public:
+		iterator(size_t word, view* v) : _word(word), _view(v) { seek(); }
+		iterator operator++() {
+			_bits &= _bits - 1;
+			if (_bits == 0) {
+				_word++;
+				seek();
+			}
+			return *this;
+		}
+
+		size_t index() { return _word * 64 + __builtin_ctzll(_bits); }
+		bool operator!=(const iterator& other) const { return _word < other._word; }
+		std::tuple<Ts&...> operator*() { return _view->get(index()); }
+	private:
+		size_t _word;
+		u64 _bits = 0;
+		view* _view;
+
+		void seek() {
+			for (; _word < _view->num_words(); _word++) {
+				_bits = _view->presence_word(_word);
+				if (_bits != 0) return;
+			}
+		}
+	};
+
+	iterator begin() { return iterator(0, this); }
+	iterator end() { return iterator(num_words(), this); }
+
+	size_t num_words() { return std::apply([](auto&... p) { return std::min({p.num_words()...}); }, pools); }
+	u64 presence_word(size_t word) { return std::apply([word](auto&... p) { return (p.presence_word(word) & ...); }, pools); }
+	std::tuple<Ts&...> get(size_t index) { return std::apply([index](auto&... p) { return std::tuple<Ts&...>(p.get(index)...); }, pools); }
+private:
+	std::tuple<pool<Ts>&...> pools;
+};
+
+// Calls func(word) for each of num_words presence words, spread across the thread pool
+template<typename F>
+void parallel_for_words(thread_pool& workers, size_t num_words, F&& func) {
+	parallel_for_ranges(workers, num_words, [&func](size_t first, size_t last) {
+		for (size_t word = first; word < last; word++) func(word);
+	});
+}
+
+// Calls func on every component in the pool, 64 entities at a time across the thread pool.
+// func runs on several threads at once, so it may only touch the component it's given.
+template<typename T, typename F>
+void parallel_for_each(thread_pool& workers, pool<T>& components, F&& func) {
+	parallel_for_words(workers, components.num_words(), [&components, &func](size_t word) {
+		for (u64 bits = components.presence_word(word); bits != 0; bits &= bits - 1) {
+			func(components.get(word * 64 + __builtin_ctzll(bits)));
+		}
+	});
+}
+
+// As above, for every entity in the view, calling func(T1&, T2&...)
+template<typename... Ts, typename F>
+void parallel_for_each(thread_pool& workers, view<Ts...> entities, F&& func) {
+	parallel_for_words(workers, entities.num_words(), [&entities, &func](size_t word) {
+		for (u64 bits = entities.presence_word(word); bits != 0; bits &= bits - 1) {
+			std::apply(func, entities.get(word * 64 + __builtin_ctzll(bits)));
+		}
+	});
+}
 
 #define POOL_NAME(T) T ## _pool
-#define GENERATE_ACCESS_FUNCTIONS(T) constexpr pool<T>& get_pool(type_tag<T>) { return POOL_NAME(T); }
-#define GENERATE_REMOVE_CALLS(T) POOL_NAME(T).remove(e);
-#define GENERATE_POOLS(T) pool<T> POOL_NAME(T);
+#define GENERATE_ACCESS_FUNCTIONS(T, storage) constexpr pool<T>& get_pool(type_tag<T>) { return POOL_NAME(T); }
+#define GENERATE_REMOVE_CALLS(T, storage) POOL_NAME(T).remove(e);
+#define GENERATE_POOLS(T, storage) pool<T> POOL_NAME(T);
 
 class component_manager {
 public:
@@ -265,6 +479,9 @@ private:
 	ALL_COMPONENTS(GENERATE_POOLS)
 };
 
+// Bounds of every sprite in the display, in world space
+rect<f32> world_bounds(display&, pool<transform>&);
+
 
 
 ////////////////////////////////////////////
@@ -275,6 +492,13 @@ private:
 //     COMBAT SYSTEMS     //
 ////////////////////////////
 
+// A pair of overlapping entities whose teams interact, in either direction. Consumers act on both sides, as the
+// on_collide callbacks this replaces were called for both entities.
+struct contact {
+	entity a;
+	entity b;
+};
+
 struct s_shooting {
 	using bullet_func = std::function<void(std::string, world_coords, world_coords, world_coords, world_coords, collision::flags)>;
 	struct bullet {
@@ -286,18 +510,15 @@ struct s_shooting {
 	std::vector <bullet> bullet_types;
 	bullet_func shoot;
 
-	void run(pool<display>&, pool<weapon_pool>, player&);
+	void run(pool<display>&, pool<transform>&, pool<weapon_pool>&, player&);
 };
 
 struct s_health : public texture_generator {
 public:
-	void run(pool<health>&, pool<damage>&, entity_manager&);
-	void update_healthbars(pool<health>&, pool<display>&);
+	void run(pool<health>&, pool<damage>&, const std::vector<contact>&, entity_manager&);
+	void update_healthbars(view<health, display>);
 private:
 	void set_entry(u32, f32);
-
-	std::array <u32, max_entities> healthbar_sprite_indices = std::array<u32, max_entities>();
-	std::array <u32, max_entities> healthbar_atlas_indices = std::array<u32, max_entities>();
 };
 
 ////////////////////////////
@@ -307,7 +528,7 @@ private:
 struct s_text : public texture_generator {
 public:
 	s_text();
-	void run(pool<text>&, pool<display>&);
+	void run(view<text, display>);
 
     screen_coords get_text_size(std::string&);
     size_t character_at_position(std::string text, screen_coords pos);
@@ -316,21 +537,43 @@ public:
     int bytes_of_character(std::string text, int char_index);
     int character_byte_index(std::string text, int char_index);
 	std::vector<int> get_numlines(std::string& text);
+	// Draws text into the atlas as distance fields, which the renderers sharpen at whatever size it's shown. Sprites
+	// scaled after their text is drawn, like by resize_ui, stretch it instead of having it drawn again.
+	void set_distance_field(bool enabled) {
+		distance_field = enabled;
+		regenerate = true;
+	}
+	size_t glyphs_rasterized(); // Glyphs FreeType has rendered so far. Each is rendered once, then served from the cache.
+	size_t strings_shaped(); // Strings HarfBuzz has shaped so far. Measuring and drawing the same string again reuses it.
 private:
-	void render_line(std::string text, point<u16> pen, color text_color);
+	bool distance_field = false;
+	void render_line(std::string text, point<u16> pen, u16 strip_height, color text_color);
 	std::string replace_locale_macro(std::string&);
 	struct impl;
 	impl* data;
 };
 
-void system_collison_run(pool<collision>&, pool<display>&, mapdata&);
-void system_velocity_run(pool<velocity>&, pool<display>&, int);
+// Collision detection runs in two phases: the spatial hash culls pairs that can't touch, then SAT runs on the rest.
+// Hits don't act on anything directly. They're collected into contacts, which later systems consume in batch.
+struct s_collision {
+public:
+	void run(thread_pool&, view<collision, display>, pool<collision>&, pool<transform>&, mapdata&);
+
+	std::vector<contact> contacts; // Overlapping pairs found by the last run
+
+	bool use_broadphase = true; // Disabling falls back to testing every pair, for comparison
+	size_t pairs_tested = 0; // Narrow phase tests performed by the last run
+private:
+	spatial_hash grid;
+};
+
+void system_velocity_run(thread_pool&, pool<velocity>&, pool<transform>&, int);
 
 // Combine proximity detectors and keypresses to allow us to "interact" with world entities
 class s_proxinteract {
 public:
 	entity active_interact = 65535;
-	void run(pool<proximity>&, pool<widget>&, display&);
+	void run(view<proximity, widget>, rect<f32> player_bounds);
 };
 
 ////////////////////////////
@@ -338,12 +581,79 @@ public:
 ////////////////////////////
 
 struct system_manager {
+	s_collision collision;
 	s_health health;
 	s_shooting shooting;
 	s_text text;
 	s_proxinteract proxinteract;
 };
 
+//////////////////////////////
+//     SYSTEM SCHEDULER     //
+//////////////////////////////
+
+// Everything a system can declare access to: one ID per component pool, then shared state that isn't a pool
+#define GENERATE_RESOURCE_IDS(T, storage) T,
+struct resource_ids {
+	enum : u32 {
+		ALL_COMPONENTS(GENERATE_RESOURCE_IDS)
+		entity_store, // Creating entities, and adding components to them
+		contacts, // s_collision's contact list
+		texture_store, // The engine's texture manager
+		healthbar_atlas,
+		text_atlas,
+		count
+	};
+};
+using resource_set = std::bitset<resource_ids::count>;
+
+#define GENERATE_RESOURCE_ID_FUNCTIONS(T, storage) constexpr u32 resource_id(type_tag<T>) { return resource_ids::T; }
+ALL_COMPONENTS(GENERATE_RESOURCE_ID_FUNCTIONS)
+
+// The pools of every listed component type, plus any other resource IDs
+template<typename... Ts>
+resource_set resources(std::initializer_list<u32> others = {}) {
+	resource_set set;
+	(set.set(resource_id(type_tag<Ts>())), ...);
+	for (u32 id : others) set.set(id);
+	return set;
+}
+
+// Runs systems on a thread pool, concurrently wherever their declared resources allow.
+// Systems keep the order they were added in: each waits on every earlier system that writes something it touches,
+// or reads something it writes. The dependency graph is built once, on the first run.
+class system_scheduler {
+public:
+	struct timing {
+		std::string name;
+		f32 ms = 0;
+	};
+
+	void add(std::string name, resource_set reads, resource_set writes, std::function<void()> func);
+	void run(thread_pool& workers);
+	bool empty() { return systems.empty(); }
+	// Wall time of each system, and of the whole schedule, during the last run
+	const std::vector<timing>& timings() { return system_timings; }
+	f32 tick_ms() { return last_tick_ms; }
+private:
+	struct node {
+		resource_set reads;
+		resource_set writes;
+		std::function<void()> func;
+		std::vector<u32> dependents;
+		u32 num_dependencies = 0;
+	};
+	std::vector<node> systems;
+	std::vector<timing> system_timings;
+	std::unique_ptr<std::atomic<u32>[]> pending; // Unfinished dependencies of each system during a run
+	std::atomic<size_t> remaining = 0;
+	bool built = false;
+	f32 last_tick_ms = 0;
+
+	void build();
+	void run_system(u32 index, thread_pool& workers);
+};
+
 
 //////////////////////////////////////////////
 //          ECS ENGINE DECLARATION          //
@@ -355,7 +665,7 @@ public:
 	void remove(entity e) { components.get_pool(type_tag<T>()).remove(e); }
 
 	template<typename T>
-	constexpr T& get(entity e) {
+	constexpr decltype(auto) get(entity e) {
 		auto& pool = components.get_pool(type_tag<T>());
 		if (!pool.exists(e)) throw "bruh";
 		return pool.get(e);
@@ -365,21 +675,29 @@ public:
 	constexpr bool exists(entity e) { return components.get_pool(type_tag<T>()).exists(e); }
 
 	template<typename T>
-	constexpr T& add(entity e) {
-		auto& c = components.get_pool(type_tag<T>()).add(e, T());
-		c.parent = e;
-		return c;
-	}
+	constexpr decltype(auto) add(entity e) { return components.get_pool(type_tag<T>()).add(e, T()); }
+
+	bool alive(entity e) { return entities.alive(e); }
+	rect<f32> world_bounds(entity e) { return ecs::world_bounds(get<display>(e), pool<transform>()); }
+	// Runs systems and parallel loops serially and in a fixed order, so replays of the same input match exactly
+	void set_deterministic(bool enabled) { workers.deterministic = enabled; }
 
 	template<typename T>
 	constexpr pool<T>& pool() { return components.get_pool(type_tag<T>()); }
 
+	template<typename... Ts>
+	ecs::view<Ts...> view() { return ecs::view<Ts...>(components.get_pool(type_tag<Ts>())...); }
+
     system_manager systems;
+	system_scheduler scheduler;
 private:
 	entity_manager entities;
 	component_manager components;
+	thread_pool workers {thread_pool::default_workers()};
 	entity _player_id = 65535;
 	entity _map_id = 65535;
+	int _framerate_multiplier = 1;
+	void schedule_systems();
 	void run_ecs(int framerate_multiplier);
 
 	friend class ::engine;
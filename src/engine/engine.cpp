@@ -4,7 +4,7 @@
 #include <SDL2/SDL.h>
 
 void engine::run_tick() {
-    world_coords start_pos = ecs.get<ecs::display>(player_id()).get_dimensions().origin;
+    world_coords start_pos = ecs.world_bounds(player_id()).origin;
 
     ecs.run_ecs(settings.framerate_multiplier);
     ui.active_interact = ecs.systems.proxinteract.active_interact;
@@ -30,16 +30,38 @@ void engine::run_tick() {
     textures().update(ecs.systems.text.get_texture());
 
     renderer().set_camera(offset);
-    renderer().clear_sprites();
-    for (auto& display : ecs.components.get_pool(ecs::type_tag<ecs::display>())) {
-        for (auto& sprite : display) {
-            if (sprite.layer == render_layers::null) continue;
-            renderer().add_sprite(sprite);
+    // Sprites of entities with a transform are in local space, and get their world vertices in the render list.
+    // World sprites of entities off screen are never submitted, so they cost nothing further down. Static sprites are
+    // always submitted, since the renderer keeps them in GPU memory and culls them itself.
+    display::render_list& sprites = renderer().sprites();
+    rect<f32> camera = renderer().visible_area();
+    auto& transforms = ecs.pool<ecs::transform>();
+    sprites.begin_submission();
+    for (auto& dpy : ecs.components.get_pool(ecs::type_tag<ecs::display>())) {
+        bool placed = transforms.exists(dpy.parent);
+        display::sprite_placement placement;
+        if (placed) {
+            ecs::transform t = transforms.get(dpy.parent).value();
+            placement = display::sprite_placement {t.position, t.rotation, t.scale};
+        }
+        bool bounds_tested = false;
+        bool on_screen = true;
+        for (auto& sprite : dpy) {
+            // Text sprites have no texture until the text system has rendered them
+            if (sprite.layer == render_layers::null || sprite.tex == nullptr) continue;
+            if (sprite.layer == render_layers::sprites && !sprite.static_geometry) {
+                if (!bounds_tested) {
+                    on_screen = AABB_collision(ecs::world_bounds(dpy, transforms), camera);
+                    bounds_tested = true;
+                }
+                if (!on_screen) continue;
+            }
+            sprites.submit(sprite, placed ? &placement : nullptr);
         }
     }
-    renderer().mark_sprites_dirty();
+    sprites.end_submission();
 
-    world_coords end_pos = ecs.get<ecs::display>(player_id()).get_dimensions().origin;
+    world_coords end_pos = ecs.world_bounds(player_id()).origin;
     offset += (end_pos - start_pos);
 }
 
@@ -133,6 +155,8 @@ bool engine::process_events() {
 engine::engine() {
 
     display.initialize(display::display_manager::display_types(settings.flags.test(window_flags::use_software_render)), settings.resolution);
+    // Frames are drawn between ticks, so the renderer can use the ECS's threads rather than start as many again
+    renderer().share_workers(ecs.workers);
     printf("Window Initialized\n");
 
     ecs.systems.shooting.bullet_types.push_back(ecs::s_shooting::bullet{world_coords(0.3, 0.6), world_coords(0.25, 0.25), "bullet"});
@@ -148,6 +172,8 @@ engine::engine() {
 
     ecs.systems.health.set_texture(textures().add("healthbar_atlas"));
     ecs.systems.text.set_texture(textures().add("text_atlas"));
+    // UI text scales with resize_ui instead of being drawn again
+    ecs.systems.text.set_distance_field(true);
 
     auto& inv = ecs.add<ecs::inventory>(player_id());
     ecs.add<ecs::display>(player_id());
@@ -78,6 +78,7 @@ public:
 
 
 	sprite_coords get_text_size(std::string text) { return ecs.systems.text.get_text_size(text).to<f32>(); }
+	size_t draw_calls() { return display.get_renderer().draw_calls(); }
 	bool in_dungeon = false;
 	world_coords offset = world_coords(0, 0);
     std::bitset<8> command_states;
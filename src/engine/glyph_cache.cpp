@@ -0,0 +1,41 @@
+#include "glyph_cache.h"
+#include <cstring>
+
+const glyph_cache::glyph& glyph_cache::get(FT_Face face, u32 glyph_id, format glyph_format) {
+    key k {face, face->size->metrics.y_ppem, glyph_id, glyph_format};
+    auto found = glyphs.find(k);
+    if (found != glyphs.end()) return found->second;
+    return glyphs.emplace(k, rasterize(face, glyph_id, glyph_format)).first->second;
+}
+
+glyph_cache::glyph glyph_cache::rasterize(FT_Face face, u32 glyph_id, format glyph_format) {
+    glyph g;
+    // Glyphs FreeType can't render are kept as empty, so they aren't attempted again
+    FT_Render_Mode mode = glyph_format == format::distance_field ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL;
+    if (FT_Load_Glyph(face, glyph_id, FT_LOAD_DEFAULT) != 0 || FT_Render_Glyph(face->glyph, mode) != 0) return g;
+    glyphs_rasterized++;
+
+    FT_GlyphSlot slot = face->glyph;
+    FT_Bitmap& bmp = slot->bitmap;
+    g.bearing = point<i32>(slot->bitmap_left, slot->bitmap_top);
+    g.bitmap_size = size<u16>(bmp.width, bmp.rows);
+    // Glyphs are padded by a texel, so coverage never bleeds between neighbours if the atlas is ever filtered.
+    // A glyph only fits on a page along with its padding, so an empty page always has room for it.
+    if (bmp.width == 0 || bmp.rows == 0 || bmp.width + 1 > page_size || bmp.rows + 1 > page_size) {
+        g.bitmap_size = size<u16>(0, 0);
+        return g;
+    }
+
+    size<u16> padded(bmp.width + 1, bmp.rows + 1);
+    if (pages.empty() || !pages.back().packer.insert(padded, g.atlas_pos)) {
+        pages.emplace_back();
+        pages.back().packer.insert(padded, g.atlas_pos);
+    }
+    g.page = pages.size() - 1;
+
+    u8* dest = pages.back().coverage.data() + g.atlas_pos.x + size_t(g.atlas_pos.y) * page_size;
+    for (u32 y = 0; y < bmp.rows; y++) {
+        memcpy(dest + size_t(y) * page_size, bmp.buffer + y * bmp.pitch, bmp.width);
+    }
+    return g;
+}
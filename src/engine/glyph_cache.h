@@ -0,0 +1,62 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <common/basic_types.h>
+#include <common/skyline_packer.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <unordered_map>
+#include <vector>
+
+// Glyphs rasterized by FreeType, kept for as long as the text system lives. Each glyph is rendered the first time it's
+// asked for at a given face, size and format, and packed into a persistent 8 bit atlas, so composing text again
+// afterwards never goes back to FreeType.
+class glyph_cache : no_copy, no_move {
+public:
+    static constexpr u16 page_size = 512;
+
+    enum class format : u8 {
+        coverage,
+        distance_field // FreeType's signed distance fields, which reach distance_field_spread texels past the outline
+    };
+
+    struct glyph {
+        u16 page = 0;
+        point<u16> atlas_pos; // Top left of the glyph's coverage on its page
+        size<u16> bitmap_size;
+        point<i32> bearing; // FreeType's bitmap_left and bitmap_top
+    };
+
+    const glyph& get(FT_Face face, u32 glyph_id, format glyph_format = format::coverage);
+    const glyph& get_char(FT_Face face, char c) { return get(face, FT_Get_Char_Index(face, u8(c))); }
+    // Coverage of the glyph's top left texel. Rows are page_size apart.
+    const u8* coverage(const glyph& g) { return pages[g.page].coverage.data() + g.atlas_pos.x + size_t(g.atlas_pos.y) * page_size; }
+
+    size_t glyphs_rasterized = 0;
+private:
+    struct key {
+        FT_Face face;
+        u32 pixel_size;
+        u32 glyph_id;
+        format glyph_format;
+        bool operator==(const key& rhs) const {
+            return face == rhs.face && pixel_size == rhs.pixel_size && glyph_id == rhs.glyph_id && glyph_format == rhs.glyph_format;
+        }
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<const void*>()(k.face) ^ ((u64(k.pixel_size) << 32 | k.glyph_id) * 0x9E3779B97F4A7C15ull) ^ size_t(k.glyph_format);
+        }
+    };
+    struct page {
+        skyline_packer packer {size<u16>(page_size, page_size)};
+        std::vector<u8> coverage = std::vector<u8>(size_t(page_size) * page_size, 0);
+    };
+
+    std::unordered_map<key, glyph, key_hash> glyphs;
+    std::vector<page> pages;
+
+    glyph rasterize(FT_Face face, u32 glyph_id, format glyph_format);
+};
+
+#endif //GLYPH_CACHE_H
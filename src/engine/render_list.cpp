@@ -0,0 +1,119 @@
+#include "render_list.h"
+#include <common/radix_sort.h>
+#include <algorithm>
+#include <cmath>
+
+namespace display {
+
+void render_list::begin_submission() {
+    tick++;
+    sprites_updated = 0;
+}
+
+void render_list::submit(sprite_data& sprite, const sprite_placement* placement) {
+    // The handle stored in the sprite only counts if its slot was filled from this very sprite,
+    // so copied sprites and sprites moved by a vector growing get slots of their own
+    u32 handle = sprite.render_handle;
+    if (handle >= slots.size() || !slots[handle].live || slots[handle].source != &sprite) {
+        if (free_slots.empty()) {
+            handle = slots.size();
+            slots.emplace_back();
+        } else {
+            handle = free_slots.back();
+            free_slots.pop_back();
+        }
+        slot& s = slots[handle];
+        s.live = true;
+        s.source = &sprite;
+        sprite.render_handle = handle;
+        update_quads(s, sprite, placement);
+        order_dirty = true;
+    }
+
+    slot& s = slots[handle];
+    s.last_submitted = tick;
+    s.sprite.layer = sprite.layer;
+    s.sprite.z_index = sprite.z_index;
+    s.sprite.tex = sprite.tex;
+    s.sprite.static_geometry = sprite.static_geometry;
+    u64 key = sprite.sort_key();
+    if (s.key != key) {
+        s.key = key;
+        s.version = ++next_version;
+        order_dirty = true;
+        for (quad_instance& instance : s.instances) instance.z_index = sprite.z_index;
+    }
+    bool moved = (placement != nullptr) != s.placed || (placement != nullptr && *placement != s.placement);
+    if (s.revision != sprite.revision() || moved) update_quads(s, sprite, placement);
+}
+
+void render_list::update_quads(slot& s, sprite_data& sprite, const sprite_placement* placement) {
+    s.sprite.tex = sprite.tex;
+    s.sprite.layer = sprite.layer;
+    s.sprite.z_index = sprite.z_index;
+    s.sprite.static_geometry = sprite.static_geometry;
+    s.key = sprite.sort_key();
+    s.revision = sprite.revision();
+    s.version = ++next_version;
+    s.placed = placement != nullptr;
+
+    // Sprites in world space are read in place, and only placed sprites are copied to be moved into the world
+    const sprite_data* world_sprite = &sprite;
+    if (placement != nullptr) {
+        s.placement = *placement;
+        placed_sprite = sprite;
+        placed_sprite.apply_transform(placement->position, placement->rotation, placement->scale);
+        world_sprite = &placed_sprite;
+    }
+    const std::vector<vertex>& vertices = world_sprite->vertices();
+    s.instances.resize(vertices.size() / vertices_per_quad);
+    for (size_t quad = 0; quad < s.instances.size(); quad++) {
+        s.instances[quad] = quad_instance::from_vertices(&vertices[quad * vertices_per_quad], sprite.z_index);
+    }
+
+    // Quads that were never placed sit at the origin with no size, and would stretch the bounds out to it
+    bool empty = true;
+    sprite_coords min(0, 0), max(0, 0);
+    for (const quad_instance& quad : s.instances) {
+        if (quad.size.x == 0 || quad.size.y == 0) continue;
+        f32 sin_r = std::abs(sin(quad.rotation));
+        f32 cos_r = std::abs(cos(quad.rotation));
+        sprite_coords half_extent(std::abs(quad.size.x) * cos_r + std::abs(quad.size.y) * sin_r, std::abs(quad.size.x) * sin_r + std::abs(quad.size.y) * cos_r);
+        half_extent *= 0.5f;
+        sprite_coords quad_min = quad.center - half_extent;
+        sprite_coords quad_max = quad.center + half_extent;
+        min = empty ? quad_min : sprite_coords(std::min(min.x, quad_min.x), std::min(min.y, quad_min.y));
+        max = empty ? quad_max : sprite_coords(std::max(max.x, quad_max.x), std::max(max.y, quad_max.y));
+        empty = false;
+    }
+    s.bounds = rect<f32>(min, max - min);
+    sprites_updated++;
+}
+
+void render_list::end_submission() {
+    for (u32 handle = 0; handle < slots.size(); handle++) {
+        slot& s = slots[handle];
+        if (!s.live || s.last_submitted == tick) continue;
+        s.live = false;
+        s.source = nullptr;
+        free_slots.push_back(handle);
+        order_dirty = true;
+    }
+}
+
+const std::vector<u32>& render_list::draw_order() {
+    if (!order_dirty) return ordered;
+    entries.clear();
+    for (u32 handle = 0; handle < slots.size(); handle++) {
+        if (slots[handle].live) entries.push_back(draw_entry {slots[handle].key, handle});
+    }
+    // The sort is stable, so sprites sharing a key keep their slot order from frame to frame
+    radix_sort(entries, entries_scratch, [](const draw_entry& e) { return e.key; });
+    ordered.clear();
+    for (draw_entry& e : entries) ordered.push_back(e.handle);
+    order_dirty = false;
+    times_sorted++;
+    return ordered;
+}
+
+}
@@ -0,0 +1,76 @@
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+#include <common/graphical_types.h>
+#include <vector>
+
+namespace display {
+
+// Where a local space sprite sits in the world, see sprite_data::apply_transform
+struct sprite_placement {
+    sprite_coords position;
+    f32 rotation = 0;
+    sprite_coords scale {1, 1};
+
+    bool operator==(const sprite_placement& rhs) const { return position == rhs.position && rotation == rhs.rotation && scale == rhs.scale; }
+    bool operator!=(const sprite_placement& rhs) const { return !(*this == rhs); }
+};
+
+// The renderer's persistent copy of every visible sprite, kept between frames.
+// Every tick, each visible sprite is submitted again. Sprites that haven't changed cost a comparison.
+// Changed sprites have their quads rebuilt in the existing slot. Only changes to layer, z index or texture, or sprites
+// coming and going, re-sort the draw order. Sprites that weren't submitted during a tick are dropped at its end.
+class render_list {
+public:
+    void begin_submission();
+    // Placement is null for sprites that are already in world space
+    void submit(sprite_data& sprite, const sprite_placement* placement);
+    void end_submission();
+
+    // Handles of every live sprite, in draw order
+    const std::vector<u32>& draw_order();
+    // Layer, z index, texture and flags of the sprite. Its vertices aren't kept, see instances.
+    sprite_data& get(u32 handle) { return slots[handle].sprite; }
+    // The sprite's quads in world space, as the renderers consume them
+    const std::vector<quad_instance>& instances(u32 handle) { return slots[handle].instances; }
+    rect<f32> bounds(u32 handle) { return slots[handle].bounds; }
+    // Changes whenever the handle's quads do, and is never reused, so renderers can cache per handle
+    u32 version(u32 handle) { return slots[handle].version; }
+    bool live(u32 handle) { return handle < slots.size() && slots[handle].live; }
+    size_t size() { return slots.size() - free_slots.size(); }
+
+    size_t sprites_updated = 0; // Sprites whose quads were rebuilt during the last tick
+    size_t times_sorted = 0;
+private:
+    struct slot {
+        sprite_data sprite {0, nullptr, 0, render_layers::null};
+        std::vector<quad_instance> instances;
+        rect<f32> bounds;
+        u32 version = 0;
+        const sprite_data* source = nullptr;
+        u32 revision = 0;
+        u64 key = 0; // sprite_data::sort_key when last submitted
+        sprite_placement placement;
+        bool placed = false;
+        u32 last_submitted = 0;
+        bool live = false;
+    };
+    std::vector<slot> slots;
+    std::vector<u32> free_slots;
+    struct draw_entry {
+        u64 key;
+        u32 handle;
+    };
+    std::vector<draw_entry> entries, entries_scratch;
+    std::vector<u32> ordered;
+    u32 tick = 0;
+    u32 next_version = 0;
+    bool order_dirty = false;
+    sprite_data placed_sprite {0, nullptr, 0, render_layers::null}; // Scratch copy for placing local space sprites
+
+    void update_quads(slot&, sprite_data& sprite, const sprite_placement* placement);
+};
+
+}
+
+#endif //RENDER_LIST_H
@@ -0,0 +1,82 @@
+#include "scaled_texture_cache.h"
+#include <cstring>
+
+namespace display {
+
+bool scaled_texture_cache::key::operator==(const key& rhs) const {
+    return texture_id == rhs.texture_id && memcmp(region, rhs.region, sizeof(region)) == 0
+        && memcmp(target, rhs.target, sizeof(target)) == 0 && filter == rhs.filter;
+}
+
+size_t scaled_texture_cache::key_hash::operator()(const key& k) const {
+    u64 a = (u64(k.texture_id) << 32) | (u64(k.target[0]) << 16) | k.target[1];
+    u64 b = (u64(k.region[0]) << 48) | (u64(k.region[1]) << 32) | (u64(k.region[2]) << 16) | k.region[3];
+    u64 h = (a ^ (b * 0x9E3779B97F4A7C15ull)) * 0xFF51AFD7ED558CCDull;
+    return h ^ (h >> 32) ^ u64(k.filter);
+}
+
+raster_texture* scaled_texture_cache::get(u32 texture_id, raster_texture& source, rect<i32> region, size<u16> target, texture_filter filter,
+                                          u64 frame) {
+    key k {texture_id, {u16(region.origin.x), u16(region.origin.y), u16(region.size.x), u16(region.size.y)}, {target.x, target.y}, filter};
+    auto found = lookup.find(k);
+    if (found != lookup.end()) {
+        hits++;
+        entries.splice(entries.begin(), entries, found->second);
+        found->second->last_used = frame;
+        return &found->second->scaled;
+    }
+
+    misses++;
+    size_t bytes = size_t(target.x) * target.y * 4;
+    auto seen = requested.find(k);
+    if (seen == requested.end() || seen->second == frame || bytes > budget_bytes) {
+        // Forget one-off requests from long ago, so the table stays about as big as a frame's worth of quads
+        if (requested.size() > lookup.size() + 4096) {
+            for (auto it = requested.begin(); it != requested.end();) it = it->second + 1 < frame ? requested.erase(it) : std::next(it);
+        }
+        requested[k] = frame;
+        return nullptr;
+    }
+    requested.erase(seen);
+
+    image scaled(std::vector<u8>(bytes), target);
+    point<f32> step(f32(region.size.x) / target.x, f32(region.size.y) / target.y);
+    for (u16 y = 0; y < target.y; y++) {
+        sample_row(source, region, step, point<i32>(0, y), target.x, filter, scaled.data().data() + size_t(y) * target.x * 4);
+    }
+    entries.push_front(entry {k, raster_texture::premultiplied(std::move(scaled)), frame});
+    lookup[k] = entries.begin();
+    _bytes_used += bytes;
+    evict(frame);
+    return &entries.front().scaled;
+}
+
+void scaled_texture_cache::invalidate(u32 texture_id) {
+    invalidate(texture_id, rect<i32>(point<i32>(0, 0), size<i32>(65536, 65536)));
+}
+
+void scaled_texture_cache::invalidate(u32 texture_id, rect<i32> area) {
+    for (auto it = entries.begin(); it != entries.end();) {
+        const u16* region = it->k.region;
+        bool overlaps = region[0] < area.origin.x + area.size.x && area.origin.x < region[0] + region[2]
+                        && region[1] < area.origin.y + area.size.y && area.origin.y < region[1] + region[3];
+        if (it->k.texture_id != texture_id || !overlaps) {
+            it++;
+            continue;
+        }
+        _bytes_used -= size_t(it->k.target[0]) * it->k.target[1] * 4;
+        lookup.erase(it->k);
+        it = entries.erase(it);
+    }
+}
+
+void scaled_texture_cache::evict(u64 frame) {
+    while (_bytes_used > budget_bytes && entries.back().last_used != frame) {
+        entry& oldest = entries.back();
+        _bytes_used -= size_t(oldest.k.target[0]) * oldest.k.target[1] * 4;
+        lookup.erase(oldest.k);
+        entries.pop_back();
+    }
+}
+
+}
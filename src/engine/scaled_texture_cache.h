@@ -0,0 +1,55 @@
+#ifndef SCALED_TEXTURE_CACHE_H
+#define SCALED_TEXTURE_CACHE_H
+
+#include "tiled_rasterizer.h"
+#include <list>
+#include <unordered_map>
+
+namespace display {
+
+// Scaled copies of texture regions for the software renderer, keyed by texture, region and size on screen.
+// A copy is only made once the same region has been asked for at the same size in two different frames. Until then,
+// get returns null and the quad should be sampled directly, so sizes that change every frame never fill the cache.
+// Least recently used copies are dropped once the cache is over its budget, except those used during the current
+// frame, which the rasterizer may still be drawing from.
+class scaled_texture_cache : no_copy, no_move {
+public:
+    explicit scaled_texture_cache(size_t budget_bytes_in) : budget_bytes(budget_bytes_in) {}
+
+    raster_texture* get(u32 texture_id, raster_texture& source, rect<i32> region, size<u16> target, texture_filter filter, u64 frame);
+    // Drops every copy made from the texture, for when its pixels change
+    void invalidate(u32 texture_id);
+    // Drops only the copies made from regions overlapping the area, for when just that part changed
+    void invalidate(u32 texture_id, rect<i32> area);
+
+    size_t bytes_used() { return _bytes_used; }
+    size_t hits = 0;
+    size_t misses = 0;
+private:
+    struct key {
+        u32 texture_id;
+        u16 region[4];
+        u16 target[2];
+        texture_filter filter;
+        bool operator==(const key& rhs) const;
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const;
+    };
+    struct entry {
+        key k;
+        raster_texture scaled;
+        u64 last_used;
+    };
+
+    size_t budget_bytes;
+    size_t _bytes_used = 0;
+    std::list<entry> entries; // Most recently used first
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> lookup;
+    std::unordered_map<key, u64, key_hash> requested; // Frame each uncached key was last asked for
+
+    void evict(u64 frame);
+};
+
+}
+#endif //SCALED_TEXTURE_CACHE_H
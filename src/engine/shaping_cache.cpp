@@ -0,0 +1,33 @@
+#include "shaping_cache.h"
+
+size_t shaped_text::bytes_used() const {
+    return glyph_ids.size() * sizeof(u32) + (advances.size() + offsets.size()) * sizeof(sprite_coords)
+        + (line_breaks.size() + graphemes.size()) * sizeof(int);
+}
+
+const shaped_text* shaping_cache::find(std::string_view text, const void* font, u32 pixel_size) {
+    auto found = lookup.find(key {text, font, pixel_size});
+    if (found == lookup.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    return &found->second->shaped;
+}
+
+const shaped_text& shaping_cache::insert(std::string_view text, const void* font, u32 pixel_size, shaped_text shaped) {
+    entries.push_front(entry {std::string(text), key {}, std::move(shaped)});
+    entry& e = entries.front();
+    e.k = key {e.text, font, pixel_size};
+    lookup[e.k] = entries.begin();
+    _bytes_used += e.text.size() + e.shaped.bytes_used();
+
+    // The string just added is at the front, so it's never the one dropped
+    while (_bytes_used > budget_bytes && entries.size() > 1) {
+        _bytes_used -= entries.back().text.size() + entries.back().shaped.bytes_used();
+        lookup.erase(entries.back().k);
+        entries.pop_back();
+    }
+    return e.shaped;
+}
@@ -0,0 +1,61 @@
+#ifndef SHAPING_CACHE_H
+#define SHAPING_CACHE_H
+
+#include <common/basic_types.h>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A string as HarfBuzz shaped it, along with where it wraps and where its characters start
+struct shaped_text {
+    std::vector<u32> glyph_ids;
+    std::vector<sprite_coords> advances;
+    std::vector<sprite_coords> offsets;
+    std::vector<int> line_breaks; // Index each line ends at. The last is the length of the string.
+    std::vector<int> graphemes; // Index each user perceived character starts at, followed by the length of the string
+
+    size_t glyph_count() const { return glyph_ids.size(); }
+    size_t bytes_used() const;
+};
+
+// Shaped strings keyed by their text, font and pixel size, so measuring, hit testing and drawing the same label
+// shape it once between them. Least recently used strings are dropped once the cache is over its budget.
+class shaping_cache : no_copy, no_move {
+public:
+    explicit shaping_cache(size_t budget_bytes_in) : budget_bytes(budget_bytes_in) {}
+
+    // Null if the string hasn't been shaped with this font at this size, or has since been dropped
+    const shaped_text* find(std::string_view text, const void* font, u32 pixel_size);
+    // Only for strings find has just returned null for
+    const shaped_text& insert(std::string_view text, const void* font, u32 pixel_size, shaped_text shaped);
+
+    size_t bytes_used() { return _bytes_used; }
+    size_t hits = 0;
+    size_t misses = 0;
+private:
+    struct key {
+        std::string_view text; // Points into the entry's own copy of the string
+        const void* font;
+        u32 pixel_size;
+        bool operator==(const key& rhs) const { return text == rhs.text && font == rhs.font && pixel_size == rhs.pixel_size; }
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<std::string_view>()(k.text) ^ ((std::hash<const void*>()(k.font) + k.pixel_size) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+    struct entry {
+        std::string text;
+        key k;
+        shaped_text shaped;
+    };
+
+    size_t budget_bytes;
+    size_t _bytes_used = 0;
+    std::list<entry> entries; // Most recently used first
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> lookup;
+};
+
+#endif //SHAPING_CACHE_H
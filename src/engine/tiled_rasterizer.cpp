@@ -0,0 +1,508 @@
+#include "tiled_rasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(SSE)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace display {
+
+raster_texture::raster_texture(image rgba) : _pixels(std::move(rgba)) {
+    convert(rect<i32>(point<i32>(0, 0), size().to<i32>()));
+    summarize_opacity();
+}
+
+raster_texture raster_texture::premultiplied(image bgra) {
+    raster_texture tex;
+    tex._pixels = std::move(bgra);
+    tex.summarize_opacity();
+    return tex;
+}
+
+raster_texture raster_texture::distance_field(image rgba) {
+    raster_texture tex;
+    tex._pixels = std::move(rgba);
+    tex.straight_alpha = true;
+    tex.convert(rect<i32>(point<i32>(0, 0), tex.size().to<i32>()));
+    tex.summarize_opacity();
+    return tex;
+}
+
+void raster_texture::update(image& rgba, rect<i32> area) {
+    size_t stride = size_t(size().x) * 4;
+    for (i32 y = area.origin.y; y < area.origin.y + area.size.y; y++) {
+        size_t start = y * stride + area.origin.x * 4;
+        memcpy(_pixels.data().data() + start, rgba.data().data() + start, size_t(area.size.x) * 4);
+    }
+    convert(area);
+    summarize_opacity(area);
+}
+
+// RGBA to BGRA, premultiplying unless alpha is a distance
+void raster_texture::convert(rect<i32> area) {
+    for (i32 y = area.origin.y; y < area.origin.y + area.size.y; y++) {
+        u8* texel = _pixels.data().data() + (size_t(y) * size().x + area.origin.x) * 4;
+        for (i32 x = 0; x < area.size.x; x++, texel += 4) {
+            if (straight_alpha) {
+                std::swap(texel[0], texel[2]);
+                continue;
+            }
+            u8 a = texel[3];
+            u8 r = texel[0];
+            texel[0] = (texel[2] * a + 127) / 255;
+            texel[1] = (texel[1] * a + 127) / 255;
+            texel[2] = (r * a + 127) / 255;
+        }
+    }
+}
+
+void raster_texture::summarize_opacity() {
+    ::size<u16> tex_size = _pixels.size();
+    block_columns = (tex_size.x + block_size - 1) / block_size;
+    i32 block_rows = (tex_size.y + block_size - 1) / block_size;
+    opaque_blocks.assign(block_columns * block_rows, 1);
+    summarize_opacity(rect<i32>(point<i32>(0, 0), tex_size.to<i32>()));
+}
+
+// Every block the area touches is summarized again whole
+void raster_texture::summarize_opacity(rect<i32> area) {
+    i32 first_x = area.origin.x / block_size * block_size;
+    i32 first_y = area.origin.y / block_size * block_size;
+    i32 last_x = std::min<i32>((area.origin.x + area.size.x + block_size - 1) / block_size * block_size, size().x);
+    i32 last_y = std::min<i32>((area.origin.y + area.size.y + block_size - 1) / block_size * block_size, size().y);
+    for (i32 y = first_y; y < last_y; y += block_size) {
+        for (i32 x = first_x; x < last_x; x += block_size) opaque_blocks[(y / block_size) * block_columns + x / block_size] = 1;
+    }
+    for (i32 y = first_y; y < last_y; y++) {
+        const u8* texel = _pixels.data().data() + (size_t(y) * size().x + first_x) * 4;
+        for (i32 x = first_x; x < last_x; x++, texel += 4) {
+            if (texel[3] != 255) opaque_blocks[(y / block_size) * block_columns + x / block_size] = 0;
+        }
+    }
+}
+
+bool raster_texture::opaque(point<i32> texel, ::size<i32> area) {
+    i32 block_rows = i32(opaque_blocks.size()) / std::max(1, block_columns);
+    i32 first_column = std::max(0, texel.x / block_size);
+    i32 first_row = std::max(0, texel.y / block_size);
+    i32 last_column = std::min(block_columns - 1, (texel.x + area.x - 1) / block_size);
+    i32 last_row = std::min(block_rows - 1, (texel.y + area.y - 1) / block_size);
+    for (i32 row = first_row; row <= last_row; row++) {
+        for (i32 column = first_column; column <= last_column; column++) {
+            if (!opaque_blocks[row * block_columns + column]) return false;
+        }
+    }
+    return true;
+}
+
+// x * a / 255, rounded, without a division
+static inline u8 scale_channel(u32 x, u32 a) {
+    u32 t = x * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+void blend_span_scalar(u8* dest, const u8* src, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++, dest += 4, src += 4) {
+        u32 a = src[3];
+        if (a == 255) {
+            memcpy(dest, src, 4);
+        } else if (a != 0) {
+            for (int c = 0; c < 4; c++) dest[c] = src[c] + scale_channel(dest[c], 255 - a);
+        }
+    }
+}
+
+#if defined(SSE)
+// Scales the 16 bit channels of dest by the 16 bit inverse alphas, with the same rounding as scale_channel
+static inline __m128i scale_channels(__m128i dest, __m128i inverse_alpha) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(dest, inverse_alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+#if defined(__AVX2__)
+static inline __m256i scale_channels(__m256i dest, __m256i inverse_alpha) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(dest, inverse_alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+#endif
+
+void blend_span(u8* dest, const u8* src, size_t pixels) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i alpha_mask_8 = _mm256_set1_epi32(0xFF000000);
+    const __m256i zero_8 = _mm256_setzero_si256();
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i alpha = _mm256_and_si256(s, alpha_mask_8);
+        // Runs of fully opaque or fully transparent pixels, the common case in sprites and text, skip the arithmetic
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alpha_mask_8)) == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4), s);
+            continue;
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero_8)) == -1) continue;
+
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i * 4));
+        __m256i a = _mm256_srli_epi32(s, 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        __m256i inverse_alpha = _mm256_xor_si256(a, _mm256_set1_epi8(-1));
+        __m256i lo = scale_channels(_mm256_unpacklo_epi8(d, zero_8), _mm256_unpacklo_epi8(inverse_alpha, zero_8));
+        __m256i hi = scale_channels(_mm256_unpackhi_epi8(d, zero_8), _mm256_unpackhi_epi8(inverse_alpha, zero_8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+#endif
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i alpha = _mm_and_si128(s, alpha_mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alpha_mask)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), s);
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF) continue;
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i * 4));
+        // Spread each pixel's alpha over its four channels, then invert it
+        __m128i a = _mm_srli_epi32(s, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i inverse_alpha = _mm_xor_si128(a, _mm_set1_epi8(-1));
+        __m128i lo = scale_channels(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(inverse_alpha, zero));
+        __m128i hi = scale_channels(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(inverse_alpha, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    blend_span_scalar(dest + i * 4, src + i * 4, pixels - i);
+}
+#elif defined(__ARM_NEON)
+void blend_span(u8* dest, const u8* src, size_t pixels) {
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        // Loads eight pixels split into one register per channel
+        uint8x8x4_t s = vld4_u8(src + i * 4);
+        if (vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(s.val[3])), 0) == 0) {
+            vst4_u8(dest + i * 4, s);
+            continue;
+        }
+        if (vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0) == 0) continue;
+
+        uint8x8x4_t d = vld4_u8(dest + i * 4);
+        uint8x8_t inverse_alpha = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t t = vaddq_u16(vmull_u8(d.val[c], inverse_alpha), vdupq_n_u16(128));
+            d.val[c] = vqadd_u8(s.val[c], vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8));
+        }
+        vst4_u8(dest + i * 4, d);
+    }
+    blend_span_scalar(dest + i * 4, src + i * 4, pixels - i);
+}
+#else
+void blend_span(u8* dest, const u8* src, size_t pixels) { blend_span_scalar(dest, src, pixels); }
+#endif
+
+void sample_row(raster_texture& source, rect<i32> region, point<f32> step, point<i32> first, size_t count, texture_filter filter, u8* out) {
+    const u8* pixels = source.pixels().data().data();
+    size_t stride = size_t(source.size().x) * 4;
+    i32 max_x = region.origin.x + region.size.x - 1;
+    i32 max_y = region.origin.y + region.size.y - 1;
+    auto clamp_x = [&](i32 x) { return std::clamp(x, region.origin.x, max_x); };
+    auto clamp_y = [&](i32 y) { return std::clamp(y, region.origin.y, max_y); };
+
+    // Source positions are 16.16 fixed point, at the center of each output texel. Computing them from the output texel
+    // means a row sampled in pieces, tile by tile, comes out the same as one sampled whole.
+    int64_t step_x = std::llround(double(step.x) * 65536);
+    int64_t step_y = std::llround(double(step.y) * 65536);
+    int64_t u_fixed = (int64_t(region.origin.x) << 16) + ((2 * first.x + 1) * step_x) / 2;
+    int64_t v_fixed = (int64_t(region.origin.y) << 16) + ((2 * first.y + 1) * step_y) / 2;
+    if (filter == texture_filter::nearest) {
+        const u8* row = pixels + clamp_y(v_fixed >> 16) * stride;
+        for (size_t i = 0; i < count; i++, u_fixed += step_x) {
+            memcpy(out + i * 4, row + clamp_x(u_fixed >> 16) * 4, 4);
+        }
+        return;
+    }
+
+    // Bilinear, with 8 bit weights. Texels are premultiplied, so filtering them directly is correct. Distance fields aren't,
+    // but their color is the same all over a strip of text, so only the distance is really being filtered.
+    v_fixed -= 32768;
+    i32 y0 = v_fixed >> 16;
+    u32 fy = (v_fixed >> 8) & 255;
+    const u8* top = pixels + clamp_y(y0) * stride;
+    const u8* bottom = pixels + clamp_y(y0 + 1) * stride;
+    u_fixed -= 32768;
+    for (size_t i = 0; i < count; i++, u_fixed += step_x) {
+        i32 x0 = u_fixed >> 16;
+        u32 fx = (u_fixed >> 8) & 255;
+        i32 left = clamp_x(x0) * 4;
+        i32 right = clamp_x(x0 + 1) * 4;
+        for (int c = 0; c < 4; c++) {
+            u32 upper = top[left + c] * (256 - fx) + top[right + c] * fx;
+            u32 lower = bottom[left + c] * (256 - fx) + bottom[right + c] * fx;
+            out[i * 4 + c] = (upper * (256 - fy) + lower * fy + 32768) >> 16;
+        }
+    }
+    if (filter == texture_filter::distance_field) distance_to_coverage(out, count, std::max(step.x, step.y));
+}
+
+// Reads one texel at a fractional position in source texels, for quads whose rows don't follow the texture's rows
+static void sample_texel(raster_texture& source, rect<i32> bounds, point<f32> position, texture_filter filter, u8* out) {
+    const u8* pixels = source.pixels().data().data();
+    size_t stride = size_t(source.size().x) * 4;
+    auto clamp_x = [&](i32 x) { return std::clamp(x, bounds.origin.x, bounds.origin.x + bounds.size.x - 1); };
+    auto clamp_y = [&](i32 y) { return std::clamp(y, bounds.origin.y, bounds.origin.y + bounds.size.y - 1); };
+    if (filter == texture_filter::nearest) {
+        memcpy(out, pixels + clamp_y(i32(std::floor(position.y))) * stride + clamp_x(i32(std::floor(position.x))) * 4, 4);
+        return;
+    }
+
+    f32 u = position.x - 0.5f;
+    f32 v = position.y - 0.5f;
+    i32 x0 = i32(std::floor(u));
+    i32 y0 = i32(std::floor(v));
+    u32 fx = u32((u - x0) * 256) & 255;
+    u32 fy = u32((v - y0) * 256) & 255;
+    const u8* top = pixels + clamp_y(y0) * stride;
+    const u8* bottom = pixels + clamp_y(y0 + 1) * stride;
+    i32 left = clamp_x(x0) * 4;
+    i32 right = clamp_x(x0 + 1) * 4;
+    for (int c = 0; c < 4; c++) {
+        u32 upper = top[left + c] * (256 - fx) + top[right + c] * fx;
+        u32 lower = bottom[left + c] * (256 - fx) + bottom[right + c] * fx;
+        out[c] = (upper * (256 - fy) + lower * fy + 32768) >> 16;
+    }
+}
+
+void distance_to_coverage(u8* texels, size_t count, f32 texels_per_pixel) {
+    // Distance grows by 128 / distance_field_spread per texel, so a screen pixel spans that many times texels_per_pixel.
+    // Coverage goes from 0 to 255 across that span, centered on the edge, then color is premultiplied by it.
+    f32 distance_per_pixel = 128.0f / distance_field_spread * texels_per_pixel;
+    i32 gain = std::lround(255 * 256 / std::max(distance_per_pixel, 1.0f));
+    for (size_t i = 0; i < count; i++) {
+        u8* texel = texels + i * 4;
+        u32 coverage = std::clamp(128 + (((texel[3] - 128) * gain) >> 8), 0, 255);
+        texel[0] = (texel[0] * coverage + 127) / 255;
+        texel[1] = (texel[1] * coverage + 127) / 255;
+        texel[2] = (texel[2] * coverage + 127) / 255;
+        texel[3] = coverage;
+    }
+}
+
+// Draws the texels under the quad into the framebuffer, clipped to the given pixel area
+static void render_quad(framebuffer& fb, rect<i32> clip, image& texture_data, point<i32> tl, point<i32> br, point<i32> texel, bool opaque) {
+    point<i32> tl_clipped(std::max(tl.x, clip.origin.x), std::max(tl.y, clip.origin.y));
+    point<i32> br_clipped(std::min(br.x, clip.origin.x + clip.size.x), std::min(br.y, clip.origin.y + clip.size.y));
+    // Never read past the texture, even when rounding leaves the quad a pixel bigger than it
+    br_clipped.x = std::min(br_clipped.x, tl.x + texture_data.size().x - texel.x);
+    br_clipped.y = std::min(br_clipped.y, tl.y + texture_data.size().y - texel.y);
+    if (tl_clipped.x >= br_clipped.x || tl_clipped.y >= br_clipped.y) return;
+
+    point<i32> tl_texel = texel + (tl_clipped - tl);
+    size_t fb_write_start = (tl_clipped.x + size_t(tl_clipped.y) * fb.size().x) * 4;
+    size_t fb_write_stride = size_t(fb.size().x) * 4;
+    size_t tex_read_start = (tl_texel.x + size_t(tl_texel.y) * texture_data.size().x) * 4;
+    size_t tex_read_stride = size_t(texture_data.size().x) * 4;
+    size_t bytes_per_line = size_t(br_clipped.x - tl_clipped.x) * 4;
+
+    for (i32 y = 0; y < br_clipped.y - tl_clipped.y; y++) {
+        u8* dest = fb.data() + fb_write_start + y * fb_write_stride;
+        const u8* src = texture_data.data().data() + tex_read_start + y * tex_read_stride;
+        if (opaque) memcpy(dest, src, bytes_per_line);
+        else blend_span(dest, src, bytes_per_line / 4);
+    }
+}
+
+// As above, resampling the source region to the quad's size one row at a time
+static void render_scaled_quad(framebuffer& fb, rect<i32> clip, raster_texture& source, rect<i32> region, point<i32> tl, point<i32> br,
+                               texture_filter filter, bool opaque) {
+    point<i32> tl_clipped(std::max(tl.x, clip.origin.x), std::max(tl.y, clip.origin.y));
+    point<i32> br_clipped(std::min(br.x, clip.origin.x + clip.size.x), std::min(br.y, clip.origin.y + clip.size.y));
+    if (tl_clipped.x >= br_clipped.x || tl_clipped.y >= br_clipped.y) return;
+
+    // Tiles are at most 64 pixels wide, so one row of samples fits on the stack
+    u8 samples[tiled_rasterizer::tile_size * 4];
+    point<f32> step(f32(region.size.x) / (br.x - tl.x), f32(region.size.y) / (br.y - tl.y));
+    size_t count = br_clipped.x - tl_clipped.x;
+    for (i32 y = tl_clipped.y; y < br_clipped.y; y++) {
+        sample_row(source, region, step, point<i32>(tl_clipped.x - tl.x, y - tl.y), count, filter, samples);
+        u8* dest = fb.data() + (tl_clipped.x + size_t(y) * fb.size().x) * 4;
+        if (opaque) memcpy(dest, samples, count * 4);
+        else blend_span(dest, samples, count);
+    }
+}
+
+// As above, for rotated and mirrored quads. Each pixel is mapped back into the region on its own, and only pixels whose
+// center falls inside the quad are drawn. Quads are convex, so those make up a single span on every row.
+static void render_transformed_quad(framebuffer& fb, rect<i32> clip, raster_texture& source, rect<i32> region, point<i32> tl, point<i32> br,
+                                    point<f32> origin, point<f32> s_axis, point<f32> t_axis, texture_filter filter, bool opaque) {
+    point<i32> tl_clipped(std::max(tl.x, clip.origin.x), std::max(tl.y, clip.origin.y));
+    point<i32> br_clipped(std::min(br.x, clip.origin.x + clip.size.x), std::min(br.y, clip.origin.y + clip.size.y));
+    if (tl_clipped.x >= br_clipped.x || tl_clipped.y >= br_clipped.y) return;
+
+    // Flipped regions are read backwards from their origin, but samples are clamped to the texels they actually cover
+    rect<i32> bounds(point<i32>(std::min(region.origin.x, region.origin.x + region.size.x), std::min(region.origin.y, region.origin.y + region.size.y)),
+                     size<i32>(std::abs(region.size.x), std::abs(region.size.y)));
+    // How far one pixel moves through the region, for turning distance fields into coverage
+    f32 texels_per_pixel = std::max(std::hypot(s_axis.x * region.size.x, s_axis.y * region.size.x),
+                                    std::hypot(t_axis.x * region.size.y, t_axis.y * region.size.y));
+    u8 samples[tiled_rasterizer::tile_size * 4];
+    for (i32 y = tl_clipped.y; y < br_clipped.y; y++) {
+        point<f32> p(tl_clipped.x + 0.5f - origin.x, y + 0.5f - origin.y);
+        f32 s = s_axis.x * p.x + s_axis.y * p.y;
+        f32 t = t_axis.x * p.x + t_axis.y * p.y;
+        i32 first = -1;
+        size_t count = 0;
+        for (i32 x = tl_clipped.x; x < br_clipped.x; x++, s += s_axis.x, t += t_axis.x) {
+            if (s < 0 || s >= 1 || t < 0 || t >= 1) {
+                if (first >= 0) break;
+                continue;
+            }
+            if (first < 0) first = x;
+            point<f32> texel(region.origin.x + s * region.size.x, region.origin.y + t * region.size.y);
+            sample_texel(source, bounds, texel, filter, samples + count * 4);
+            count++;
+        }
+        if (count == 0) continue;
+
+        if (filter == texture_filter::distance_field) distance_to_coverage(samples, count, texels_per_pixel);
+        u8* dest = fb.data() + (first + size_t(y) * fb.size().x) * 4;
+        if (opaque) memcpy(dest, samples, count * 4);
+        else blend_span(dest, samples, count);
+    }
+}
+
+tiled_rasterizer::tiled_rasterizer(size_t num_workers) { set_workers(num_workers); }
+
+void tiled_rasterizer::set_workers(size_t num_workers) {
+    own_workers = std::make_unique<thread_pool>(num_workers);
+    workers = own_workers.get();
+}
+
+void tiled_rasterizer::share_workers(thread_pool& pool) {
+    workers = &pool;
+    own_workers.reset();
+}
+
+void tiled_rasterizer::begin_frame(framebuffer& target, bool clear) {
+    fb = target;
+    clear_tiles = clear;
+    tile_columns = (fb.size().x + tile_size - 1) / tile_size;
+    tile_rows = (fb.size().y + tile_size - 1) / tile_size;
+    bins.resize(tile_columns * tile_rows);
+    // Bins and commands keep their capacity, so a steady-state frame doesn't allocate
+    for (auto& bin : bins) bin.clear();
+    commands.clear();
+    num_opaque = 0;
+}
+
+void tiled_rasterizer::add(raster_texture& texture_data, point<i32> texel, point<f32> tl, point<f32> br) {
+    command c;
+    c.texture_data = &texture_data;
+    c.tl = point<i32>(std::lround(tl.x), std::lround(tl.y));
+    c.br = point<i32>(std::lround(br.x), std::lround(br.y));
+    c.texel = texel;
+    c.type = command_type::copy;
+    if (!bin(c)) return;
+
+    c.opaque = texture_data.opaque(c.texel, size<i32>(c.br.x - c.tl.x, c.br.y - c.tl.y));
+    num_opaque += c.opaque;
+    commands.push_back(c);
+}
+
+void tiled_rasterizer::add_scaled(raster_texture& source, rect<i32> region, point<f32> tl, point<f32> br, texture_filter filter) {
+    command c;
+    c.texture_data = &source;
+    c.tl = point<i32>(std::lround(tl.x), std::lround(tl.y));
+    c.br = point<i32>(std::lround(br.x), std::lround(br.y));
+    c.region = region;
+    c.type = command_type::scaled;
+    c.filter = filter;
+    if (region.size.x <= 0 || region.size.y <= 0 || !bin(c)) return;
+
+    c.opaque = source.opaque(region.origin, region.size);
+    num_opaque += c.opaque;
+    commands.push_back(c);
+}
+
+void tiled_rasterizer::add_transformed(raster_texture& source, rect<i32> region, point<f32> origin, point<f32> across, point<f32> down,
+                                       texture_filter filter) {
+    f32 determinant = across.x * down.y - across.y * down.x;
+    if (region.size.x == 0 || region.size.y == 0 || std::abs(determinant) < 1e-6f) return;
+
+    point<f32> far = origin + across + down;
+    point<f32> corners[3] = {origin + across, origin + down, far};
+    point<f32> min = origin;
+    point<f32> max = origin;
+    for (point<f32> corner : corners) {
+        min = point<f32>(std::min(min.x, corner.x), std::min(min.y, corner.y));
+        max = point<f32>(std::max(max.x, corner.x), std::max(max.y, corner.y));
+    }
+
+    command c;
+    c.texture_data = &source;
+    c.tl = point<i32>(i32(std::floor(min.x)), i32(std::floor(min.y)));
+    c.br = point<i32>(i32(std::ceil(max.x)), i32(std::ceil(max.y)));
+    c.region = region;
+    c.type = command_type::transformed;
+    c.filter = filter;
+    c.origin = origin;
+    c.s_axis = point<f32>(down.y, -down.x) / determinant;
+    c.t_axis = point<f32>(-across.y, across.x) / determinant;
+    if (!bin(c)) return;
+
+    point<i32> texel(std::min(region.origin.x, region.origin.x + region.size.x), std::min(region.origin.y, region.origin.y + region.size.y));
+    c.opaque = source.opaque(texel, size<i32>(std::abs(region.size.x), std::abs(region.size.y)));
+    num_opaque += c.opaque;
+    commands.push_back(c);
+}
+
+// Adds the next command's index to every tile it touches. Returns false for commands that are entirely off screen.
+bool tiled_rasterizer::bin(command& c) {
+    i32 first_column = std::max(0, c.tl.x / tile_size);
+    i32 first_row = std::max(0, c.tl.y / tile_size);
+    i32 last_column = std::min(tile_columns - 1, (c.br.x - 1) / tile_size);
+    i32 last_row = std::min(tile_rows - 1, (c.br.y - 1) / tile_size);
+    if (c.br.x <= 0 || c.br.y <= 0 || first_column > last_column || first_row > last_row) return false;
+
+    u32 index = commands.size();
+    for (i32 row = first_row; row <= last_row; row++) {
+        for (i32 column = first_column; column <= last_column; column++) {
+            bins[row * tile_columns + column].push_back(index);
+        }
+    }
+    return true;
+}
+
+void tiled_rasterizer::draw_tile(size_t tile) {
+    point<i32> origin(i32(tile % tile_columns) * tile_size, i32(tile / tile_columns) * tile_size);
+    rect<i32> clip(origin, size<i32>(std::min(tile_size, fb.size().x - origin.x), std::min(tile_size, fb.size().y - origin.y)));
+    if (clear_tiles) {
+        for (i32 y = clip.origin.y; y < clip.origin.y + clip.size.y; y++) {
+            memset(fb.data() + (clip.origin.x + size_t(y) * fb.size().x) * 4, 0, clip.size.x * 4);
+        }
+    }
+    for (u32 index : bins[tile]) {
+        command& c = commands[index];
+        switch (c.type) {
+            case command_type::copy:
+                render_quad(fb, clip, c.texture_data->pixels(), c.tl, c.br, c.texel, c.opaque);
+                break;
+            case command_type::scaled:
+                render_scaled_quad(fb, clip, *c.texture_data, c.region, c.tl, c.br, c.filter, c.opaque);
+                break;
+            case command_type::transformed:
+                render_transformed_quad(fb, clip, *c.texture_data, c.region, c.tl, c.br, c.origin, c.s_axis, c.t_axis, c.filter, c.opaque);
+                break;
+        }
+    }
+}
+
+void tiled_rasterizer::finish_frame() {
+    parallel_for_ranges(*workers, bins.size(), [this](size_t first, size_t last) {
+        for (size_t tile = first; tile < last; tile++) draw_tile(tile);
+    });
+}
+
+}
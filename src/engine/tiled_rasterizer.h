@@ -0,0 +1,130 @@
+#ifndef TILED_RASTERIZER_H
+#define TILED_RASTERIZER_H
+
+#include <common/graphical_types.h>
+#include <common/thread_pool.h>
+#include <memory>
+#include <vector>
+
+namespace display {
+
+// A texture in the layout the rasterizer draws from: BGRA, with premultiplied alpha. Opacity is summarized per 8x8 block
+// of texels, so quads that only show opaque texels can be copied instead of blended.
+class raster_texture {
+public:
+    raster_texture() = default;
+    // Converts from RGBA with straight alpha, the layout textures are loaded in
+    explicit raster_texture(image rgba);
+    // Takes pixels that are already premultiplied BGRA, like resampled copies of another raster_texture
+    static raster_texture premultiplied(image bgra);
+    // Converts from RGBA whose alpha is a distance field. Alpha stays as it is, and is only sampled with
+    // texture_filter::distance_field.
+    static raster_texture distance_field(image rgba);
+
+    // Converts just the area again from the RGBA image this texture was made from, after it changed there
+    void update(image& rgba, rect<i32> area);
+
+    image& pixels() { return _pixels; }
+    ::size<u16> size() { return _pixels.size(); }
+    bool opaque(point<i32> texel, ::size<i32> area);
+private:
+    static constexpr i32 block_size = 8;
+    image _pixels;
+    std::vector<u8> opaque_blocks;
+    i32 block_columns = 0;
+    bool straight_alpha = false; // Set for distance fields
+
+    void convert(rect<i32> area);
+    void summarize_opacity();
+    void summarize_opacity(rect<i32> area);
+};
+
+enum class texture_filter {
+    nearest,
+    bilinear,
+    distance_field // Bilinear, then alpha is turned from distance into coverage, with edges a screen pixel wide
+};
+
+// Writes count texels of the source region, stretched so that each output texel covers step source texels, into out.
+// first is the output texel to start at, relative to the region's top left. Samples never reach outside the region.
+void sample_row(raster_texture& source, rect<i32> region, point<f32> step, point<i32> first, size_t count, texture_filter filter, u8* out);
+
+// Turns distance field texels, already sampled at the size they're drawn, into premultiplied coverage with edges a pixel wide.
+// texels_per_pixel is how many source texels one output pixel spans.
+void distance_to_coverage(u8* texels, size_t count, f32 texels_per_pixel);
+
+// Draws src over dest, both premultiplied BGRA. Uses SSE2 when built with SSE, AVX2 when the compiler targets it,
+// and NEON on ARM, with the scalar version for whatever is left over.
+void blend_span(u8* dest, const u8* src, size_t pixels);
+void blend_span_scalar(u8* dest, const u8* src, size_t pixels);
+
+// The software renderer's back end. The framebuffer is split into 64x64 pixel tiles, and every quad added during a frame
+// is binned into each tile it touches. finish_frame then draws the tiles in parallel, one thread per tile at a time.
+// A tile's quads are drawn in the order they were added, so sorted draw order holds wherever quads overlap.
+class tiled_rasterizer : no_copy, no_move {
+public:
+    static constexpr i32 tile_size = 64;
+
+    explicit tiled_rasterizer(size_t num_workers);
+    // Threads drawing tiles, besides the one calling finish_frame, in a pool of the rasterizer's own
+    void set_workers(size_t num_workers);
+    // Draws tiles on a pool owned elsewhere, like the engine's, so two pools don't compete for the same cores.
+    // The pool must outlive the rasterizer, and mustn't be busy with other work while a frame is finished.
+    void share_workers(thread_pool& pool);
+    size_t num_threads() { return workers->num_threads(); }
+
+    // With clear set, each tile is cleared to black right before its quads are drawn
+    void begin_frame(framebuffer& target, bool clear);
+    // tl and br are in framebuffer pixels, and texel is the texel drawn at tl. texture_data is drawn 1:1, so it must
+    // already be scaled to the quad's size, and it has to stay alive until finish_frame. Quads are blended over what's
+    // below them unless every texel they show is opaque.
+    void add(raster_texture& texture_data, point<i32> texel, point<f32> tl, point<f32> br);
+    // Draws region, in source texels, stretched over the quad from tl to br. Texels are sampled as each row is drawn,
+    // for quads whose size is a one-off and not worth keeping a scaled copy of.
+    void add_scaled(raster_texture& source, rect<i32> region, point<f32> tl, point<f32> br, texture_filter filter);
+    // Draws region stretched over a parallelogram, for quads that are rotated or mirrored. The region's top left corner
+    // lands at origin, and its top right and bottom left corners at origin + across and origin + down. A region with a
+    // negative size is read backwards from its origin, for textures flipped along that axis.
+    void add_transformed(raster_texture& source, rect<i32> region, point<f32> origin, point<f32> across, point<f32> down, texture_filter filter);
+    void finish_frame();
+
+    size_t quads_added() { return commands.size(); }
+    size_t opaque_quads() { return num_opaque; }
+private:
+    enum class command_type : u8 {
+        copy,
+        scaled,
+        transformed
+    };
+    struct command {
+        raster_texture* texture_data;
+        point<i32> tl;
+        point<i32> br;
+        point<i32> texel; // Texel under tl
+        bool opaque;
+        command_type type;
+        texture_filter filter;
+        rect<i32> region; // Source area of scaled and transformed quads
+        // Transformed quads map a pixel p to the region as s = dot(s_axis, p - origin) and t = dot(t_axis, p - origin),
+        // with s and t running from 0 to 1 across and down it
+        point<f32> origin;
+        point<f32> s_axis;
+        point<f32> t_axis;
+    };
+
+    bool bin(command& c);
+    void draw_tile(size_t tile);
+
+    std::unique_ptr<thread_pool> own_workers;
+    thread_pool* workers = nullptr;
+    framebuffer fb;
+    bool clear_tiles = false;
+    i32 tile_columns = 0;
+    i32 tile_rows = 0;
+    std::vector<command> commands;
+    size_t num_opaque = 0;
+    std::vector<std::vector<u32>> bins; // Commands touching each tile, in the order they were added
+};
+
+}
+#endif //TILED_RASTERIZER_H
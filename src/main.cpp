@@ -138,7 +138,12 @@ int main(int, char **) {
         w.process_events();
 
         if ( fpscounter.elapsed<timer::seconds>().count() >= 1.0 ) {
-            printf("%f ms/frame\n", 1000.0f / double(numframes));
+            printf("%f ms/frame, %zu draw calls/frame\n", 1000.0f / double(numframes), w.draw_calls());
+#ifdef PROFILE_SYSTEMS
+            printf("ecs tick: %.3f ms (", w.ecs.scheduler.tick_ms());
+            for (auto& system : w.ecs.scheduler.timings()) printf(" %s %.3f", system.name.c_str(), system.ms);
+            printf(" )\n");
+#endif
             numframes = 0;
             fpscounter.start();
             //resize_ui(w, 1.25);
@@ -60,7 +60,8 @@ sprite_coords get_max_textsize(engine& g, T macro_name) {
 template <typename T, typename... Args>
 sprite_coords get_max_textsize(engine& g, T macro_name, Args... args) {
     sprite_coords size = g.get_text_size(macro_name);
-    return sprite_coords(std::max(size.x, get_max_textsize(g, args...).x), std::min(size.y, get_max_textsize(g, args...).y));
+    sprite_coords rest = get_max_textsize(g, args...);
+    return sprite_coords(std::max(size.x, rest.x), std::min(size.y, rest.y));
 }
 
 #endif //UI_HELPER_FUNCS_H
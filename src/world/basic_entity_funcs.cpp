@@ -13,14 +13,19 @@ void egen_bullet(entity e, engine& game, std::string texname,
 
 	 ecs::display& spr = game.ecs.add<ecs::display>(e);
 	spr.add_sprite(1, game.textures().get(texname.c_str()), 3, render_layers::sprites);
-	spr.sprites(0).set_pos(source, dimensions, 0);
+	// Centered on the local origin, so the transform rotates the bullet in place
+	spr.sprites(0).set_pos(dimensions * -0.5f, dimensions, 0);
 	spr.sprites(0).set_tex_region(0, 0);
-	spr.sprites(0).rotate(atan2(dest.x - source.x, (source.y - dest.y)));
+
+	auto t = game.ecs.add<ecs::transform>(e);
+	t.set_position(source + dimensions * 0.5f);
+	t.set_rotation(atan2(dest.x - source.x, (source.y - dest.y)));
 
 
 
 	 ecs::damage& o = game.ecs.add<ecs::damage>(e);
 	o.damage = 25;
+	o.destroy_on_hit = true;
 
 	 ecs::collision& c = game.ecs.add<ecs::collision>(e);
 	c.set_team_signal(team);
@@ -28,11 +33,6 @@ void egen_bullet(entity e, engine& game, std::string texname,
 	c.set_tilemap_collision( ecs::collision::flags::air);
 	//c.set_tilemap_collision(collision_types::ground);
 	//c.p_id = e.ID();
-	c.on_collide = [=, &game, &o](u32 ID)
-	{
-		o.enemy_ID = ID;
-		game.destroy_entity(e);
-	};
 
 
 	world_coords delta(dest.x - source.x, dest.y - source.y);
@@ -55,17 +55,13 @@ void egen_enemy(entity e, engine& game, world_coords pos)
 
 
 	ecs::collision& c = game.ecs.add<ecs::collision>(e);
-	c.disabled_sprites.push_back(1);
+	c.disabled_sprites.set(1);
 	ecs::health& h = game.ecs.add<ecs::health>(e);
 	h.has_healthbar = true;
-	ecs::damage& d = game.ecs.add<ecs::damage>(e);
+	game.ecs.add<ecs::damage>(e);
 
 	c.set_team_signal( ecs::collision::flags::enemy);
 	c.set_team_detector( ecs::collision::flags::ally);
-	c.on_collide = [=, &d](u32 ID)
-	{
-		d.enemy_ID = ID;
-	};
 
 	h.health = 100;
 	h.max_health = 100;
@@ -78,8 +74,9 @@ void setup_player(engine& game)
 	ecs::display& spr = game.ecs.add<ecs::display>(e);
 	spr.add_sprite(1, game.textures().get("player"), 2, render_layers::sprites);
 
-	spr.sprites(0).set_pos(sprite_coords(9, 9), sprite_coords(1, 1), 0);
+	spr.sprites(0).set_pos(sprite_coords(0, 0), sprite_coords(1, 1), 0);
 	spr.sprites(0).set_tex_region(0, 0);
+	game.ecs.add<ecs::transform>(e).set_position(world_coords(9, 9));
 
 	game.ecs.add<ecs::velocity>(e);
 	game.ecs.add<ecs::weapon_pool>(e);
@@ -99,17 +96,6 @@ void setup_player(engine& game)
 	 ecs::collision& c = game.ecs.add<ecs::collision>(e);
 	c.set_team_detector( ecs::collision::flags::enemy);
 	c.set_tilemap_collision( ecs::collision::flags::ground);
-	c.on_collide = [e, &game](u32 ID)
-	{
-		if(ID == game.map_id()) {
-			auto& velocity = game.ecs.get<ecs::velocity>(e);
-			 ecs::display& spr2 = game.ecs.get<ecs::display>(e);
-			for (auto& sprite : spr2) {
-			    sprite.move_by(sprite_coords(0, 0) - velocity.delta);
-			}
-			printf("player collides with wall \n");
-		}
-	};
 }
 
 void basic_sprite_setup(entity e, engine& g, render_layers layer, sprite_coords origin, sprite_coords pos_size, size_t tex_index, std::string texname) {
@@ -102,17 +102,33 @@ void set_map(engine& game, world_coords dimensions, std::vector<u8> tiles) {
     ecs::mapdata& mapdata = game.ecs.get<ecs::mapdata>(e);
     set_tilecollison_lookup(mapdata);
 
-	spr.add_sprite(tiles.size(), game.textures().get("tilemap"), 0, render_layers::sprites);
+	// The map is split into square chunks, one static sprite each, so the renderer can keep them on the GPU
+	// and skip the chunks that are off screen
+	constexpr int chunk_tiles = 32;
+	int chunks_x = (int(dimensions.x) + chunk_tiles - 1) / chunk_tiles;
+	int chunks_y = (int(dimensions.y) + chunk_tiles - 1) / chunk_tiles;
+	texture* map_tex = game.textures().get("tilemap");
+	for (int cy = 0; cy < chunks_y; cy++) {
+		for (int cx = 0; cx < chunks_x; cx++) {
+			int width = std::min(chunk_tiles, int(dimensions.x) - cx * chunk_tiles);
+			int height = std::min(chunk_tiles, int(dimensions.y) - cy * chunk_tiles);
+			spr.add_sprite(width * height, map_tex, 0, render_layers::sprites);
+			spr.sprites(cx + cy * chunks_x).static_geometry = true;
+		}
+	}
 
 	size_t index = 0;
 	u8 tile_type = 0;
 
-    texture* map_tex = spr.sprites(0).tex;
 	std::vector<u8> modified_map(tiles.size());
 	auto write_tile = [&] (f32 pos_x, f32 pos_y, f32 tex_x, f32 tex_y) {
+		int x = pos_x, y = pos_y;
+		sprite_data& chunk = spr.sprites((x / chunk_tiles) + (y / chunk_tiles) * chunks_x);
+		int width = std::min(chunk_tiles, int(dimensions.x) - (x / chunk_tiles) * chunk_tiles);
+		size_t quad = (x % chunk_tiles) + (y % chunk_tiles) * width;
 		size_t tex_index = tex_x + (tex_y * map_tex->regions.x);
-		spr.sprites(0).set_pos(sprite_coords(pos_x, pos_y), sprite_coords(1, 1), index);
-		spr.sprites(0).set_tex_region(tex_index, index);
+		chunk.set_pos(sprite_coords(pos_x, pos_y), sprite_coords(1, 1), quad);
+		chunk.set_tex_region(tex_index, quad);
 		index++;
 	};
 
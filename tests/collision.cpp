@@ -0,0 +1,26 @@
+#include "test.h"
+#include <engine/ecs.h>
+
+TEST(collision_hull_follows_disabled_sprites) {
+    texture tex {0, image(), size<u16>(1, 1)};
+    ecs::display dpy;
+    dpy.add_sprite(1, &tex, 0, render_layers::sprites);
+    dpy.add_sprite(1, &tex, 0, render_layers::sprites);
+    dpy.sprites(0).set_pos(sprite_coords(0, 0), sprite_coords(1, 1), 0);
+    dpy.sprites(1).set_pos(sprite_coords(0, -2), sprite_coords(1, 0.25f), 0);
+
+    ecs::collision c;
+    c.update_hull(dpy, nullptr);
+    CHECK(c.shape.points.size() == 8);
+    CHECK(c.shape.bounds.origin.y == -2);
+
+    // Disabling a sprite leaves every sprite's vertices as they were, but must still drop it from the hull
+    c.disabled_sprites.set(1);
+    c.update_hull(dpy, nullptr);
+    CHECK(c.shape.points.size() == 4);
+    CHECK(c.shape.bounds.origin.y == 0);
+
+    c.disabled_sprites.reset(1);
+    c.update_hull(dpy, nullptr);
+    CHECK(c.shape.points.size() == 8);
+}
@@ -1,3 +1,39 @@
-int main() {
+#include "test.h"
 
-}
\ No newline at end of file
+namespace {
+bool current_failed = false;
+}
+
+std::vector<test_entry>& test_registry() {
+    static std::vector<test_entry> registry;
+    return registry;
+}
+
+int register_test(std::string name, test_func func) {
+    test_registry().push_back(test_entry{name, func});
+    return 0;
+}
+
+void report_failure(const char* file, int line, const char* expression) {
+    printf("    %s:%d: CHECK(%s) failed\n", file, line, expression);
+    current_failed = true;
+}
+
+// Usage: test_suite [test names...]. With no arguments, every test runs. Exits non-zero if any test failed.
+int main(int argc, char** argv) {
+    int failures = 0;
+    for (auto& entry : test_registry()) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            if (entry.name == argv[i]) selected = true;
+        }
+        if (!selected) continue;
+
+        current_failed = false;
+        entry.func();
+        printf("[%s] %s\n", current_failed ? "FAIL" : "ok", entry.name.c_str());
+        if (current_failed) failures++;
+    }
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
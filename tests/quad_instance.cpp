@@ -0,0 +1,115 @@
+#include "test.h"
+#include <engine/tiled_rasterizer.h>
+#include <cmath>
+
+using display::raster_texture;
+using display::texture_filter;
+using display::tiled_rasterizer;
+
+namespace {
+
+// A 4x4 opaque texture with a different color in every texel
+image numbered_texture() {
+    std::vector<u8> data;
+    for (u8 i = 0; i < 16; i++) {
+        for (u8 c : {u8(i * 16), u8(255 - i * 16), u8(i * 5), u8(255)}) data.push_back(c);
+    }
+    return image(data, size<u16>(4, 4));
+}
+
+bool same_pixel(framebuffer& fb, point<i32> pixel, raster_texture& source, point<i32> texel) {
+    const u8* a = fb.data() + (pixel.x + size_t(pixel.y) * fb.size().x) * 4;
+    const u8* b = source.pixels().data().data() + (texel.x + size_t(texel.y) * source.size().x) * 4;
+    return std::equal(a, a + 4, b);
+}
+
+}
+
+TEST(quad_instance_keeps_flipped_uvs) {
+    // Corners in order top left, top right, bottom right, bottom left, showing the texture mirrored left to right
+    vertex quad[4] = {
+        {sprite_coords(0, 0), point<f32>(1, 0)},
+        {sprite_coords(2, 0), point<f32>(0, 0)},
+        {sprite_coords(2, 1), point<f32>(0, 1)},
+        {sprite_coords(0, 1), point<f32>(1, 1)},
+    };
+    quad_instance flipped = quad_instance::from_vertices(quad, 0);
+    CHECK(flipped.uv_tl().x == 1 && flipped.uv_tl().y == 0);
+    CHECK(flipped.uv_br().x == 0 && flipped.uv_br().y == 1);
+    CHECK(!flipped.axis_aligned());
+
+    quad[0].uv.x = quad[3].uv.x = 0;
+    quad[1].uv.x = quad[2].uv.x = 1;
+    quad_instance plain = quad_instance::from_vertices(quad, 0);
+    CHECK(plain.axis_aligned());
+    CHECK(plain.size.x == 2 && plain.size.y == 1);
+    CHECK(plain.center.x == 1 && plain.center.y == 0.5f);
+}
+
+TEST(rasterizer_draws_rotated_quads) {
+    raster_texture source(numbered_texture());
+    std::vector<u8> pixels(16 * 16 * 4, 0);
+    framebuffer fb(pixels.data(), size<u16>(16, 16));
+
+    // The texture at twice its size, turned a quarter clockwise: its top edge runs down the right side
+    tiled_rasterizer raster(0);
+    raster.begin_frame(fb, true);
+    raster.add_transformed(source, rect<i32>(point<i32>(0, 0), size<i32>(4, 4)), point<f32>(10, 2), point<f32>(0, 8), point<f32>(-8, 0), texture_filter::nearest);
+    raster.finish_frame();
+
+    bool matches = true;
+    for (i32 y = 0; y < 4; y++) {
+        for (i32 x = 0; x < 4; x++) matches &= same_pixel(fb, point<i32>(10 - 2 * y - 1, 2 + 2 * x + 1), source, point<i32>(x, y));
+    }
+    CHECK(matches);
+    // Nothing is drawn outside the quad
+    CHECK(pixels[(1 + 1 * 16) * 4 + 3] == 0);
+    CHECK(pixels[(11 + 5 * 16) * 4 + 3] == 0);
+}
+
+TEST(rasterizer_draws_flipped_regions) {
+    raster_texture source(numbered_texture());
+    std::vector<u8> pixels(8 * 8 * 4, 0);
+    framebuffer fb(pixels.data(), size<u16>(8, 8));
+
+    tiled_rasterizer raster(0);
+    raster.begin_frame(fb, true);
+    raster.add_transformed(source, rect<i32>(point<i32>(4, 0), size<i32>(-4, 4)), point<f32>(0, 0), point<f32>(4, 0), point<f32>(0, 4), texture_filter::nearest);
+    raster.finish_frame();
+
+    bool matches = true;
+    for (i32 y = 0; y < 4; y++) {
+        for (i32 x = 0; x < 4; x++) matches &= same_pixel(fb, point<i32>(x, y), source, point<i32>(3 - x, y));
+    }
+    CHECK(matches);
+}
+
+TEST(rasterizer_shares_a_pool) {
+    raster_texture source(numbered_texture());
+    auto draw = [&](tiled_rasterizer& raster, std::vector<u8>& pixels) {
+        framebuffer fb(pixels.data(), size<u16>(200, 200));
+        raster.begin_frame(fb, true);
+        for (i32 i = 0; i < 40; i++) {
+            raster.add_scaled(source, rect<i32>(point<i32>(0, 0), size<i32>(4, 4)), point<f32>(i * 4, i * 3), point<f32>(i * 4 + 30, i * 3 + 50), texture_filter::bilinear);
+        }
+        raster.finish_frame();
+    };
+
+    std::vector<u8> alone(200 * 200 * 4);
+    tiled_rasterizer serial(0);
+    draw(serial, alone);
+
+    // Tiles drawn on a borrowed pool come out the same, and the pool is still usable afterwards
+    thread_pool pool(3);
+    std::vector<u8> shared(200 * 200 * 4);
+    tiled_rasterizer borrowing(0);
+    borrowing.share_workers(pool);
+    CHECK(borrowing.num_threads() == 4);
+    draw(borrowing, shared);
+    CHECK(alone == shared);
+
+    std::atomic<int> ran = 0;
+    pool.submit([&ran]() { ran++; });
+    pool.wait_until([&ran]() { return ran == 1; });
+    CHECK(ran == 1);
+}
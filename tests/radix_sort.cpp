@@ -0,0 +1,68 @@
+#include "test.h"
+#include <common/radix_sort.h>
+#include <algorithm>
+#include <random>
+
+namespace {
+
+struct keyed {
+    u64 key;
+    u32 order; // Position before sorting, to check ties keep it
+};
+
+std::vector<keyed> random_items(size_t count, u64 key_mask, u32 seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<keyed> items;
+    for (size_t i = 0; i < count; i++) items.push_back(keyed {rng() & key_mask, u32(i)});
+    return items;
+}
+
+bool sorted_and_stable(const std::vector<keyed>& items) {
+    for (size_t i = 1; i < items.size(); i++) {
+        if (items[i - 1].key > items[i].key) return false;
+        if (items[i - 1].key == items[i].key && items[i - 1].order > items[i].order) return false;
+    }
+    return true;
+}
+
+}
+
+TEST(radix_sort_orders_keys) {
+    std::vector<keyed> scratch;
+    for (u64 mask : {0xFFull, 0xFFFF00ull, 0xFFFFFFFFFFFFFFFFull, 0xF00000000000000Full}) {
+        std::vector<keyed> items = random_items(5000, mask, u32(mask));
+        std::vector<keyed> expected = items;
+        std::stable_sort(expected.begin(), expected.end(), [](const keyed& a, const keyed& b) { return a.key < b.key; });
+
+        radix_sort(items, scratch, [](const keyed& k) { return k.key; });
+        CHECK(items.size() == expected.size());
+        CHECK(sorted_and_stable(items));
+        bool same = true;
+        for (size_t i = 0; i < items.size() && same; i++) same = items[i].order == expected[i].order;
+        CHECK(same);
+    }
+}
+
+TEST(radix_sort_is_stable) {
+    // Few distinct keys, so most items tie with many others
+    std::vector<keyed> items = random_items(5000, 0x0300000000000003ull, 7);
+    std::vector<keyed> scratch;
+    radix_sort(items, scratch, [](const keyed& k) { return k.key; });
+    CHECK(sorted_and_stable(items));
+}
+
+TEST(radix_sort_edge_cases) {
+    std::vector<keyed> scratch;
+    std::vector<keyed> empty;
+    radix_sort(empty, scratch, [](const keyed& k) { return k.key; });
+    CHECK(empty.empty());
+
+    // Every pass skipped, so the items must come back untouched
+    std::vector<keyed> same_key = {{5, 0}, {5, 1}, {5, 2}};
+    radix_sort(same_key, scratch, [](const keyed& k) { return k.key; });
+    CHECK(sorted_and_stable(same_key));
+
+    std::vector<keyed> reversed = {{3, 0}, {2, 1}, {1, 2}, {0, 3}};
+    radix_sort(reversed, scratch, [](const keyed& k) { return k.key; });
+    CHECK(reversed[0].order == 3 && reversed[3].order == 0);
+}
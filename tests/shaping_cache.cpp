@@ -0,0 +1,61 @@
+#include "test.h"
+#include <engine/shaping_cache.h>
+
+namespace {
+
+shaped_text shaped_with_glyphs(size_t count) {
+    shaped_text shaped;
+    shaped.glyph_ids.assign(count, 1);
+    shaped.advances.assign(count, sprite_coords(9, 0));
+    shaped.offsets.assign(count, sprite_coords(0, 0));
+    shaped.line_breaks = {int(count)};
+    shaped.graphemes.resize(count + 1);
+    for (size_t i = 0; i <= count; i++) shaped.graphemes[i] = i;
+    return shaped;
+}
+
+}
+
+TEST(shaping_cache_finds_by_text_font_and_size) {
+    shaping_cache cache(1 << 20);
+    int font_a = 0;
+    int font_b = 0;
+    CHECK(cache.find("hello", &font_a, 16) == nullptr);
+    cache.insert("hello", &font_a, 16, shaped_with_glyphs(5));
+
+    const shaped_text* found = cache.find(std::string("hel") + "lo", &font_a, 16);
+    CHECK(found != nullptr);
+    CHECK(found && found->glyph_count() == 5);
+    CHECK(found && found->graphemes.back() == 5);
+    CHECK(cache.find("hello", &font_b, 16) == nullptr);
+    CHECK(cache.find("hello", &font_a, 17) == nullptr);
+    CHECK(cache.find("hell", &font_a, 16) == nullptr);
+    CHECK(cache.hits == 1);
+    CHECK(cache.misses == 4);
+}
+
+TEST(shaping_cache_drops_least_recently_used) {
+    int font = 0;
+    size_t entry_bytes = 1 + shaped_with_glyphs(10).bytes_used();
+    // Room for three single character strings of ten glyphs
+    shaping_cache cache(entry_bytes * 3);
+    cache.insert("a", &font, 16, shaped_with_glyphs(10));
+    cache.insert("b", &font, 16, shaped_with_glyphs(10));
+    cache.insert("c", &font, 16, shaped_with_glyphs(10));
+    CHECK(cache.bytes_used() == entry_bytes * 3);
+
+    // Touching a makes b the oldest
+    CHECK(cache.find("a", &font, 16) != nullptr);
+    cache.insert("d", &font, 16, shaped_with_glyphs(10));
+    CHECK(cache.bytes_used() <= entry_bytes * 3);
+    CHECK(cache.find("b", &font, 16) == nullptr);
+    CHECK(cache.find("a", &font, 16) != nullptr);
+    CHECK(cache.find("c", &font, 16) != nullptr);
+    CHECK(cache.find("d", &font, 16) != nullptr);
+
+    // A string bigger than the whole budget is still kept until the next insert
+    const shaped_text& big = cache.insert("e", &font, 16, shaped_with_glyphs(1000));
+    CHECK(big.glyph_count() == 1000);
+    CHECK(cache.find("e", &font, 16) != nullptr);
+    CHECK(cache.find("a", &font, 16) == nullptr);
+}
@@ -0,0 +1,55 @@
+#include "test.h"
+#include <common/skyline_packer.h>
+#include <random>
+
+namespace {
+
+bool overlaps(rect<u16> a, rect<u16> b) {
+    return a.origin.x < b.origin.x + b.size.x && b.origin.x < a.origin.x + a.size.x
+        && a.origin.y < b.origin.y + b.size.y && b.origin.y < a.origin.y + a.size.y;
+}
+
+}
+
+TEST(skyline_packer_rects_stay_apart) {
+    const size<u16> page_size(256, 256);
+    skyline_packer packer(page_size);
+    std::mt19937 rng(3);
+    std::vector<rect<u16>> placed;
+    int rejected = 0;
+    for (int i = 0; i < 400; i++) {
+        size<u16> rect_size(1 + rng() % 40, 1 + rng() % 40);
+        point<u16> position;
+        if (!packer.insert(rect_size, position)) {
+            rejected++;
+            continue;
+        }
+        placed.push_back(rect<u16>(position, rect_size));
+    }
+    // The page can't hold all of them, so both outcomes are exercised
+    CHECK(rejected > 0);
+    CHECK(placed.size() > 50);
+
+    bool in_bounds = true;
+    bool apart = true;
+    for (size_t i = 0; i < placed.size(); i++) {
+        in_bounds &= placed[i].origin.x + placed[i].size.x <= page_size.x && placed[i].origin.y + placed[i].size.y <= page_size.y;
+        for (size_t j = i + 1; j < placed.size(); j++) apart &= !overlaps(placed[i], placed[j]);
+    }
+    CHECK(in_bounds);
+    CHECK(apart);
+}
+
+TEST(skyline_packer_fills_exactly) {
+    // Sixteen 64x64 tiles fill a 256x256 page with no room to spare
+    skyline_packer packer(size<u16>(256, 256));
+    point<u16> position;
+    for (int i = 0; i < 16; i++) CHECK(packer.insert(size<u16>(64, 64), position));
+    CHECK(!packer.insert(size<u16>(1, 1), position));
+
+    skyline_packer small(size<u16>(16, 16));
+    CHECK(!small.insert(size<u16>(17, 1), position));
+    CHECK(!small.insert(size<u16>(1, 17), position));
+    CHECK(small.insert(size<u16>(16, 16), position));
+    CHECK(position.x == 0 && position.y == 0);
+}
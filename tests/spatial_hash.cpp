@@ -0,0 +1,54 @@
+#include "test.h"
+#include <common/spatial_hash.h>
+#include <random>
+#include <set>
+#include <utility>
+
+TEST(spatial_hash_matches_brute_force) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<f32> position(-20, 20);
+    std::uniform_real_distribution<f32> extent(0.1f, 5);
+
+    // Entities of every size, including ones spanning many cells and ones at negative coordinates
+    std::vector<rect<f32>> bounds;
+    for (int i = 0; i < 300; i++) bounds.push_back(rect<f32>(point<f32>(position(rng), position(rng)), size<f32>(extent(rng), extent(rng))));
+
+    spatial_hash grid;
+    for (size_t i = 0; i < bounds.size(); i++) grid.insert(entity(i), bounds[i]);
+    CHECK(grid.num_items() == bounds.size());
+
+    std::set<std::pair<entity, entity>> expected;
+    for (size_t i = 0; i < bounds.size(); i++) {
+        for (size_t j = i + 1; j < bounds.size(); j++) {
+            if (AABB_collision(bounds[i], bounds[j])) expected.emplace(entity(i), entity(j));
+        }
+    }
+
+    std::set<std::pair<entity, entity>> found;
+    bool ordered = true;
+    bool unique = true;
+    grid.for_each_pair([&](entity a, entity b) {
+        ordered &= a < b;
+        unique &= found.emplace(a, b).second;
+    });
+    CHECK(ordered);
+    CHECK(unique);
+    CHECK(found == expected);
+
+    rect<f32> area(point<f32>(-3, -3), size<f32>(6, 6));
+    std::set<entity> expected_hits;
+    for (size_t i = 0; i < bounds.size(); i++) {
+        if (AABB_collision(area, bounds[i])) expected_hits.insert(entity(i));
+    }
+    std::set<entity> hits;
+    bool hits_unique = true;
+    grid.query(area, [&](entity id) { hits_unique &= hits.insert(id).second; });
+    CHECK(hits_unique);
+    CHECK(hits == expected_hits);
+
+    grid.clear();
+    CHECK(grid.num_items() == 0);
+    int pairs = 0;
+    grid.for_each_pair([&](entity, entity) { pairs++; });
+    CHECK(pairs == 0);
+}
@@ -0,0 +1,147 @@
+#include "test.h"
+#include <common/paged_storage.h>
+#include <common/sparse_storage.h>
+#include <engine/ecs.h>
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Storages share an interface, so the same checks run against each
+template <typename storage>
+void check_storage() {
+    storage s;
+    CHECK(s.size() == 0);
+    CHECK(!s.exists(0));
+    CHECK(!s.exists(1000));
+
+    // Ids spread over several presence words, including ones far past the first
+    std::vector<size_t> ids = {0, 1, 63, 64, 130, 1000, 4095};
+    for (size_t id : ids) s.add(id, int(id) * 2);
+    CHECK(s.size() == ids.size());
+    for (size_t id : ids) {
+        CHECK(s.exists(id));
+        CHECK(s.get(id) == int(id) * 2);
+    }
+    CHECK(!s.exists(2));
+    CHECK(!s.exists(129));
+
+    // Adding an existing id replaces its element without counting it twice
+    s.add(64, 7);
+    CHECK(s.size() == ids.size());
+    CHECK(s.get(64) == 7);
+
+    s.remove(1);
+    s.remove(1000);
+    s.remove(1000);
+    s.remove(5000);
+    CHECK(s.size() == ids.size() - 2);
+    CHECK(!s.exists(1));
+    CHECK(!s.exists(1000));
+    CHECK(s.get(4095) == 4095 * 2);
+
+    // Iteration visits exactly the live ids, each once
+    std::vector<size_t> visited;
+    for (auto it = s.begin(); it != s.end(); ++it) {
+        visited.push_back(it.index());
+        CHECK(*it == s.get(it.index()));
+    }
+    std::sort(visited.begin(), visited.end());
+    CHECK((visited == std::vector<size_t> {0, 63, 64, 130, 4095}));
+
+    // The presence words agree with exists
+    for (size_t word = 0; word < s.num_words(); word++) {
+        for (size_t bit = 0; bit < 64; bit++) {
+            CHECK(((s.presence_word(word) >> bit) & 1) == u64(s.exists(word * 64 + bit)));
+        }
+    }
+}
+
+}
+
+TEST(paged_storage_add_remove) {
+    check_storage<paged_storage<int>>();
+}
+
+TEST(sparse_storage_add_remove) {
+    check_storage<sparse_storage<int>>();
+}
+
+TEST(paged_storage_references_survive_growth) {
+    paged_storage<int> s;
+    int& first = s.add(3, 42);
+    for (size_t id = 64; id < 64 * 100; id += 64) s.add(id, 0);
+    CHECK(&first == &s.get(3));
+    CHECK(first == 42);
+}
+
+TEST(entity_handles_reject_stale_ids) {
+    ecs::entity_manager entities;
+    entity a = entities.add_entity();
+    entity b = entities.add_entity();
+    CHECK(entities.alive(a));
+    CHECK(entities.alive(b));
+    CHECK(entities.num_alive() == 2);
+
+    entities.mark_entity(a);
+    const std::vector<entity>& destroyed = entities.remove_marked();
+    CHECK(destroyed.size() == 1);
+    CHECK(!destroyed.empty() && destroyed[0] == a);
+    CHECK(!entities.alive(a));
+    CHECK(entities.alive(b));
+    CHECK(entities.num_alive() == 1);
+
+    // The freed index is reused under a new generation, and the old handle stays dead
+    entity c = entities.add_entity();
+    CHECK(entity_index(c) == entity_index(a));
+    CHECK(entity_generation(c) != entity_generation(a));
+    CHECK(c != a);
+    CHECK(entities.alive(c));
+    CHECK(!entities.alive(a));
+
+    // Marks through a stale handle must not touch the entity now holding its index
+    entities.mark_entity(a);
+    CHECK(entities.remove_marked().empty());
+    CHECK(entities.alive(c));
+
+    CHECK(!entities.alive(null_entity));
+}
+
+TEST(entity_marks_are_deduplicated) {
+    ecs::entity_manager entities;
+    entity a = entities.add_entity();
+    entity b = entities.add_entity();
+    entities.mark_entity(a);
+    entities.mark_entity(a); // Marking twice destroys once
+    CHECK(entities.marked(a));
+    CHECK(!entities.marked(b));
+    CHECK(entities.remove_marked().size() == 1);
+    CHECK(!entities.marked(a));
+
+    // A stale handle can't mark the entity now holding its index
+    entity c = entities.add_entity();
+    entities.mark_entity(a);
+    CHECK(!entities.marked(c));
+    CHECK(entities.remove_marked().empty());
+}
+
+TEST(entity_marks_from_many_threads) {
+    ecs::entity_manager entities;
+    std::vector<entity> ids;
+    for (int i = 0; i < 20000; i++) ids.push_back(entities.add_entity());
+
+    // A wave far bigger than any one tick's usual marks, with every entity marked by two threads
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&entities, &ids, t]() {
+            for (size_t i = t / 2; i < ids.size(); i += 2) entities.mark_entity(ids[i]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    const std::vector<entity>& destroyed = entities.remove_marked();
+    std::vector<entity> sorted(destroyed.begin(), destroyed.end());
+    std::sort(sorted.begin(), sorted.end());
+    CHECK(sorted == ids);
+    CHECK(entities.num_alive() == 0);
+}
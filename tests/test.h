@@ -0,0 +1,29 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <common/basic_types.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal unit test registry, laid out like the benchmark suite's. Each test is a free function registered at
+// static init time, and a failed CHECK reports itself and marks the running test as failed without stopping it.
+using test_func = void (*)();
+struct test_entry {
+	std::string name;
+	test_func func;
+};
+
+std::vector<test_entry>& test_registry();
+int register_test(std::string name, test_func);
+void report_failure(const char* file, int line, const char* expression);
+
+#define TEST(name) \
+	static void name(); \
+	static int name##_registration = register_test(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) report_failure(__FILE__, __LINE__, #expression); } while (0)
+
+#endif //TEST_H
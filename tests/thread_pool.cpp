@@ -0,0 +1,20 @@
+#include "test.h"
+#include <common/thread_pool.h>
+
+TEST(parallel_for_ranges_covers_every_index_once) {
+    for (size_t workers : {0, 3}) {
+        thread_pool pool(workers);
+        for (size_t count : {0, 1, 7, 1000}) {
+            std::vector<std::atomic<int>> visits(count);
+            std::atomic<bool> well_formed = true;
+            parallel_for_ranges(pool, count, [&](size_t first, size_t last) {
+                if (first >= last || last > count) well_formed = false;
+                for (size_t i = first; i < last && i < count; i++) visits[i]++;
+            });
+            bool once = true;
+            for (auto& v : visits) once &= v == 1;
+            CHECK(well_formed);
+            CHECK(once);
+        }
+    }
+}